@@ -0,0 +1,20 @@
+#
+# src/settings_cache.c registers itself as the settings save destination
+# and forwards to the backend it replaced, which it takes from the
+# settings subsystem's private settings_save_dst. Fail here rather than
+# at link time if a Zephyr update moves it.
+#
+# Included by the application and by tests/settings_cache.
+#
+set(SETTINGS_PRIV_DIR ${ZEPHYR_BASE}/subsys/settings/src)
+
+file(STRINGS ${SETTINGS_PRIV_DIR}/settings_priv.h settings_save_dst_decl
+     REGEX "struct settings_store \\*settings_save_dst;")
+if(NOT settings_save_dst_decl)
+  message(FATAL_ERROR
+    "${SETTINGS_PRIV_DIR}/settings_priv.h no longer declares settings_save_dst, "
+    "which the settings cache replaces. Port src/settings_cache.c or set "
+    "CONFIG_SCROLL_SETTINGS_CACHE=n.")
+endif()
+
+target_include_directories(app PRIVATE ${SETTINGS_PRIV_DIR})
@@ -0,0 +1,23 @@
+#ifndef _BOOT_PROFILE_H_
+#define _BOOT_PROFILE_H_
+
+#include <zephyr/types.h>
+
+enum boot_stage {
+	BOOT_STAGE_MAIN,        /* main() entered */
+	BOOT_STAGE_BT_ENABLE,   /* bt_enable() issued, host init running */
+	BOOT_STAGE_BT_READY,    /* host and controller up */
+	BOOT_STAGE_SETTINGS,    /* identity and bonds loaded */
+	BOOT_STAGE_ADV,         /* first advertising set started */
+	BOOT_STAGE_PERIPHERALS, /* LEDs, buttons and ADC configured */
+	BOOT_STAGE_SENSOR,      /* magnetometer configured after the first connection */
+	BOOT_STAGE_COUNT
+};
+
+/* Record the first time a stage is reached, in microseconds since the kernel started */
+void boot_profile_mark(enum boot_stage stage);
+
+/* Time a stage was reached, 0 if it has not been reached yet */
+uint32_t boot_profile_get_us(enum boot_stage stage);
+
+#endif /* _BOOT_PROFILE_H_ */
@@ -0,0 +1,64 @@
+#ifndef _CALIBRATION_H_
+#define _CALIBRATION_H_
+
+#include <zephyr/types.h>
+
+#include "magnetometer.h"
+
+/* Correction nodes per revolution, one every 128 counts */
+#define CAL_TABLE_SIZE 32
+/* Constant-speed revolutions collected by one run */
+#define CAL_REVOLUTIONS 10
+/* A revolution more than this much faster or slower than the previous one is dropped */
+#define CAL_SPEED_TOLERANCE_PCT 5
+/* Every node needs this many samples, spin slower if a run fails on it */
+#define CAL_MIN_NODE_SAMPLES 3
+
+enum cal_state {
+	CAL_IDLE,
+	CAL_LEARNING,   /* collecting a new table */
+	CAL_VERIFYING,  /* measuring the stored table */
+};
+
+struct cal_report {
+	uint8_t state;              /* enum cal_state */
+	uint8_t axis;               /* enum scroll_axis_id of the current or last run */
+	uint8_t tables;             /* bit per axis with a stored table */
+	uint8_t revolutions;        /* accepted revolutions */
+	uint16_t rejected;          /* revolutions dropped for uneven speed or reversal */
+	uint16_t raw_rms_mlsb;      /* deviation from constant speed, thousandths of a count */
+	uint16_t corrected_rms_mlsb;
+};
+
+/* Corrected position in 1/16 counts, 0..65535 per revolution */
+uint16_t calibration_correct(enum scroll_axis_id axis, uint16_t raw);
+
+/* Forget the axis's table and fall back to the uncorrected angle */
+int calibration_clear(enum scroll_axis_id axis);
+
+#if CONFIG_SCROLL_CALIBRATION_LEARN
+/*
+ * Spin the wheel steadily while a run is active; the axis sends no scroll
+ * reports until it ends. Learning stores the new table when it completes.
+ */
+int calibration_start(enum scroll_axis_id axis, bool learn);
+void calibration_stop(void);
+bool calibration_running(enum scroll_axis_id axis);
+
+/* Feed one sample of the running axis, timestamped with k_cycle_get_32() */
+void calibration_sample(uint16_t raw, uint32_t cycles);
+
+void calibration_report_get(struct cal_report *report);
+#else
+/* Stored tables are still applied, only learning new ones is left out */
+static inline bool calibration_running(enum scroll_axis_id axis)
+{
+	return false;
+}
+
+static inline void calibration_sample(uint16_t raw, uint32_t cycles)
+{
+}
+#endif
+
+#endif /* _CALIBRATION_H_ */
@@ -0,0 +1,22 @@
+#ifndef _CHARGER_H_
+#define _CHARGER_H_
+
+#include <zephyr/types.h>
+
+enum charger_state {
+	CHARGER_BATTERY,	/* no VBUS, running from the cell */
+	CHARGER_CHARGING,	/* VBUS present, the charger is charging the cell */
+	CHARGER_EXTERNAL,	/* VBUS present, charge complete or no cell fitted */
+};
+
+#if CONFIG_SCROLL_CHARGER
+/* Start watching VBUS and the charger's status pin */
+int charger_init(void);
+
+enum charger_state charger_state_get(void);
+#else
+static inline int charger_init(void) { return 0; }
+static inline enum charger_state charger_state_get(void) { return CHARGER_BATTERY; }
+#endif
+
+#endif /* _CHARGER_H_ */
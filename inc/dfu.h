@@ -0,0 +1,19 @@
+#ifndef _DFU_H_
+#define _DFU_H_
+
+#include <zephyr/types.h>
+
+/* Firmware upload statistics of the current or last SMP image upload */
+struct dfu_stats {
+	uint32_t image_size;
+	uint32_t bytes;          /* received so far */
+	uint32_t transfer_ms;    /* first to last chunk */
+	uint32_t throughput_bps; /* bytes per second over the transfer */
+	uint32_t total_ms;       /* upload start to image confirmed */
+	uint32_t uploads;
+	uint32_t aborted;
+};
+
+void dfu_stats_get(struct dfu_stats *stats);
+
+#endif /* _DFU_H_ */
@@ -0,0 +1,21 @@
+#ifndef _DIAGNOSTICS_H_
+#define _DIAGNOSTICS_H_
+
+#include <zephyr/types.h>
+#include <zephyr/toolchain.h>
+
+/* Compact runtime summary, also the wire format of the status service diagnostics characteristic */
+struct diag_summary {
+	uint16_t cpu_load;            /* permille of CPU time spent outside the idle thread */
+	uint16_t sensor_load;         /* permille used by the sensor thread */
+	uint16_t bt_load;             /* permille used by the Bluetooth host threads */
+	uint16_t sensor_stack_free;   /* bytes of stack never touched */
+	uint16_t main_stack_free;
+	uint16_t sysworkq_stack_free;
+	uint16_t min_stack_free;      /* smallest untouched stack over all threads */
+	uint16_t sysworkq_latency_us; /* worst system workqueue queueing delay in the last window */
+} __packed;
+
+void diagnostics_summary_get(struct diag_summary *summary);
+
+#endif /* _DIAGNOSTICS_H_ */
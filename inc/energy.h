@@ -0,0 +1,33 @@
+#ifndef _ENERGY_H_
+#define _ENERGY_H_
+
+#include <zephyr/types.h>
+
+enum energy_scenario {
+	ENERGY_SCENARIO_ADVERTISING,	/* no host, advertising only */
+	ENERGY_SCENARIO_IDLE,		/* connected, wheel at rest */
+	ENERGY_SCENARIO_OCCASIONAL,	/* connected, a short flick every few seconds */
+	ENERGY_SCENARIO_SPINNING,	/* connected, continuous spin */
+	ENERGY_SCENARIO_COUNT
+};
+
+/* Activity over one measurement window and the charge estimated from it */
+struct energy_sample {
+	uint32_t window_ms;
+	uint32_t radio_on_us;	/* RADIO between READY and DISABLED */
+	uint32_t cpu_active_us;	/* all threads except idle, ISRs included */
+	uint32_t sensor_on_ms;	/* magnetometer supply on */
+	uint32_t wakeups;	/* exits from the idle thread */
+	uint32_t avg_na;	/* estimated average current, also nAh per hour */
+};
+
+/* Restart the measurement window */
+void energy_window_start(void);
+
+/* Activity since the window started */
+void energy_window_get(struct energy_sample *sample);
+
+/* Result of a scripted scenario, window_ms is 0 until it has run */
+void energy_scenario_get(enum energy_scenario scenario, struct energy_sample *sample);
+
+#endif /* _ENERGY_H_ */
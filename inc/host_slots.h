@@ -0,0 +1,33 @@
+#ifndef _HOST_SLOTS_H_
+#define _HOST_SLOTS_H_
+
+#include <zephyr/types.h>
+
+struct bt_conn;
+
+/* One Bluetooth identity, and so one bond, per host slot */
+#define HOST_SLOT_COUNT CONFIG_BT_ID_MAX
+
+struct host_slot_stats {
+	uint32_t switches;
+	uint32_t last_switch_ms;  /* slot selected to host connected */
+	uint32_t max_switch_ms;
+};
+
+/* Create the missing identities, call once settings are loaded */
+int host_slots_init(void);
+
+uint8_t host_slot_active(void);
+
+/* Drop the current link and reconnect to the host bonded to the slot */
+void host_slot_select(uint8_t slot);
+
+/* Forget the active slot's host and advertise for a new one */
+void host_slot_clear(void);
+
+/* Called for every new connection, completes switch time tracking */
+void host_slot_connected(struct bt_conn *conn);
+
+void host_slot_stats_get(struct host_slot_stats *stats);
+
+#endif /* _HOST_SLOTS_H_ */
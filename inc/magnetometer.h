@@ -1,6 +1,51 @@
 #ifndef _MAGNETOMETER_H_
 #define _MAGNETOMETER_H_
 
+#include <zephyr/kernel.h>
+#include <zephyr/toolchain.h>
 
+enum scroll_axis_id {
+	AXIS_WHEEL,
+	AXIS_PAN,
+	AXIS_COUNT
+};
+
+/* Magnet health snapshot, also the wire format of the status service characteristic */
+struct magnet_health {
+	uint8_t status;            /* enum as5600_magnet_status */
+	uint8_t agc;
+	uint16_t magnitude;
+	uint32_t degraded_samples; /* samples taken with the magnet out of range */
+} __packed;
+
+/* Sampling period statistics, measured with the hardware cycle counter */
+struct sample_timing {
+	uint32_t samples;
+	uint32_t overruns;      /* periods skipped because a sample ran late */
+	uint32_t jitter_max_us; /* largest deviation from the nominal period */
+	uint32_t jitter_avg_us; /* running average deviation */
+	uint32_t queue_peak;    /* most scroll events waiting to be sent at once */
+	uint32_t queue_drops;   /* events lost to a full queue */
+};
+
+extern const k_tid_t sensor_data_collector_id;
+
+/* Start the sampling thread; called on the first connection, later calls are no-ops */
+void magnetometer_start(void);
+
+/*
+ * Called right before each connection event of the lead host, interval_us
+ * being its connection interval. Starts a sample when one is due and
+ * returns true if it did.
+ */
+bool magnetometer_sync(uint32_t interval_us);
+
+/* Sample at the external power rate in the sensors' NOM mode instead of stepping down when idle */
+void magnetometer_external_power(bool on);
+
+void magnetometer_timing_get(struct sample_timing *timing);
+
+/* Total time the sensors have been powered, including the current power cycle */
+uint32_t magnetometer_powered_ms(void);
 
 #endif
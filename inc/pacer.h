@@ -0,0 +1,40 @@
+#ifndef _PACER_H_
+#define _PACER_H_
+
+#include <zephyr/types.h>
+
+#include "scroll.h"
+
+/* Smoothing of the measured ticks per connection interval, as a shift */
+#define PACER_RATE_SHIFT 2
+/* A backlog above this many intervals of motion is worked off faster */
+#define PACER_MAX_LAG_INTERVALS 3
+/* Intervals without input after which the backlog is sent at once */
+#define PACER_STOP_INTERVALS 2
+/* Intervals without input or backlog before the pacer stops ticking */
+#define PACER_IDLE_INTERVALS 4
+/* Used until the connection interval is known */
+#define PACER_DEFAULT_INTERVAL_US 15000
+
+struct pacer_stats {
+	uint32_t reports;     /* paced reports sent */
+	uint32_t bursts;      /* motion starts, sent without pacing */
+	uint32_t catchups;    /* intervals that worked off excess backlog */
+	uint32_t reversals;   /* direction changes that flushed the backlog */
+	uint16_t max_backlog; /* largest backlog in ticks, either axis */
+	uint16_t interval_us; /* pacing interval in use */
+};
+
+typedef void (*pacer_send_t)(const struct scroll_event *event);
+
+void pacer_init(pacer_send_t send);
+
+/*
+ * Hand motion from the scroll engine to the pacer. Must run on the system
+ * workqueue, where the pacing work runs as well.
+ */
+void pacer_push(const struct scroll_event *event);
+
+void pacer_stats_get(struct pacer_stats *stats);
+
+#endif /* _PACER_H_ */
@@ -1,11 +1,45 @@
 #ifndef _PAIRING_H_
 #define _PAIRING_H_
 
+#include <zephyr/bluetooth/addr.h>
+
+/* Peer address as plain log arguments, so the address is never formatted on the device */
+#define ADDR_LE_FMT "%02X:%02X:%02X:%02X:%02X:%02X (%s)"
+#define ADDR_LE_ARGS(_addr) \
+	(_addr)->a.val[5], (_addr)->a.val[4], (_addr)->a.val[3], \
+	(_addr)->a.val[2], (_addr)->a.val[1], (_addr)->a.val[0], \
+	((_addr)->type == BT_ADDR_LE_PUBLIC ? "public" : "random")
+
 typedef struct conn_mode {
 	struct bt_conn *conn;
 	bool in_boot_mode;
+	int64_t connected_at;   /* uptime of the connection, for time-to-first-report */
+	bool first_report_sent;
 } conn_mode_t;
 
+/* Enhanced ATT bearers opened per link for HID input reports */
+#define HID_EATT_CHANNELS 1
+
+enum adv_profile_id {
+	ADV_PROFILE_RECONNECT,	/* bonded hosts only */
+	ADV_PROFILE_PAIRING,	/* open to new hosts */
+	ADV_PROFILE_COUNT,
+};
+
+enum adv_phase {
+	ADV_PHASE_FAST,
+	ADV_PHASE_SLOW,
+	ADV_PHASE_STOPPED,
+};
+
+/* Time spent advertising per profile and phase, in milliseconds */
+struct adv_stats {
+	uint32_t fast_ms[ADV_PROFILE_COUNT];
+	uint32_t slow_ms[ADV_PROFILE_COUNT];
+	uint32_t sessions;	/* advertising_start() calls */
+	uint32_t timeouts;	/* sessions that ran out without a connection */
+};
+
 extern struct k_work adv_work;
 extern conn_mode_t conn_mode[];
 extern volatile bool is_adv_running;
@@ -19,5 +53,9 @@ void disconnected(struct bt_conn *conn, uint8_t reason);
 void insert_conn_object(struct bt_conn *conn);
 bool is_conn_slot_free(void);
 void advertising_start(void);
+void advertising_request_directed(void);
+bool advertising_is_stopped(void);
+void advertising_resume(void);
+void advertising_stats_get(struct adv_stats *stats);
 
 #endif /* _PAIRING_H_ */
\ No newline at end of file
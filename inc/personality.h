@@ -0,0 +1,31 @@
+#ifndef _PERSONALITY_H_
+#define _PERSONALITY_H_
+
+#include <errno.h>
+#include <zephyr/types.h>
+
+/* What the wheel sensor is reported as; both collections are always in the report map */
+enum hid_personality {
+	HID_PERSONALITY_WHEEL,	/* Wheel and AC Pan ticks, the button selects hosts */
+	HID_PERSONALITY_DIAL,	/* radial controller: Dial rotation, angle and puck button */
+	HID_PERSONALITY_COUNT
+};
+
+#if CONFIG_SCROLL_DIAL
+enum hid_personality hid_personality_get(void);
+
+/* Switch and store the personality, takes effect with the next sample */
+int hid_personality_set(enum hid_personality personality);
+#else
+static inline enum hid_personality hid_personality_get(void)
+{
+	return HID_PERSONALITY_WHEEL;
+}
+
+static inline int hid_personality_set(enum hid_personality personality)
+{
+	return -ENOTSUP;
+}
+#endif
+
+#endif /* _PERSONALITY_H_ */
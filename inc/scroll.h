@@ -6,16 +6,19 @@
 
 /* Scroll resolution multiplier - standard is 120 units per notch */
 #define SCROLL_RESOLUTION_MULTIPLIER 16
-/* Degrees per notch - adjust for sensitivity (lower = more sensitive) */
-#define SCROLL_DEGREES_PER_NOTCH 2.f
+/* Angles are handled in 1/16 sensor counts, 65536 per revolution */
+#define SCROLL_COUNTS_PER_REV 65536
+#define SCROLL_DEG_TO_COUNTS(deg) ((deg) * SCROLL_COUNTS_PER_REV / 360)
+/* Notches per revolution, 2 degrees each - adjust for sensitivity (higher = more sensitive) */
+#define SCROLL_NOTCHES_PER_REV 180
 /* Hysteresis threshold - minimum accumulated notches before sending scroll event */
 #define SCROLL_HYSTERESIS_THRESHOLD 3
 /* Inverse scroll direction */
 #define SCROLL_INVERSE 1
-/* Degrees per notch in normal mode (without multiplier) */
-#define SCROLL_DEGREES_PER_TICK_NORMAL 10.0f
-/* Degrees per tick adjusted by resolution multiplier */
-#define SCROLL_DEGREES_PER_TICK (SCROLL_DEGREES_PER_NOTCH / SCROLL_RESOLUTION_MULTIPLIER)
+/* Ticks per revolution in normal mode (without multiplier), 10 degrees each */
+#define SCROLL_TICKS_PER_REV_NORMAL 36
+/* Ticks per revolution adjusted by resolution multiplier */
+#define SCROLL_TICKS_PER_REV (SCROLL_NOTCHES_PER_REV * SCROLL_RESOLUTION_MULTIPLIER)
 /* Low power mode timeouts in milliseconds */
 #define LPM_TIMEOUT_MS 3000
 #define DOZE_TIMEOUT_MS 10000
@@ -23,12 +26,59 @@
 #define ACTIVE_MODE_PERIOD_MS 15
 #define LPM_MODE_PERIOD_MS 50
 #define DOZE_MODE_PERIOD_MS 5000
+/* On external power: NOM sensor mode, sampled faster and never stepped down */
+#define POWERED_MODE_PERIOD_MS 5
+/* Rotation speed (degrees per second) above which the sensor's fast filter is enabled */
+#define SPIN_FAST_DEG_PER_S 200
+/* Slow samples to wait before restoring the rest filter after a fast spin */
+#define SPIN_SETTLE_SAMPLES 20
+/* Samples between AGC/magnitude reads */
+#define MAGNET_HEALTH_PERIOD_SAMPLES 64
+/* Minimum interval between degraded magnet warnings */
+#define MAGNET_WARN_INTERVAL_MS 60000
+/* Degraded magnet: angle changes below half a degree are treated as noise */
+#define MAGNET_DEGRADED_DEADBAND (SCROLL_DEG_TO_COUNTS(1) / 2)
+/* Dial personality: rotation below this is sensor noise, three raw counts or about 0.26 degrees */
+#define DIAL_DEADBAND (3 * SCROLL_COUNTS_PER_REV / 4096)
+/* Degraded magnet: direction change hysteresis in ticks */
+#define MAGNET_DEGRADED_HYSTERESIS (SCROLL_HYSTERESIS_THRESHOLD * 2)
+/* Wheel motion polling period while advertising is stopped */
+#define ADV_WAKE_POLL_MS 2000
+/* Rotation (degrees) between two polls that resumes advertising */
+#define ADV_WAKE_MOTION_DEG 10
 
 
+/* One input report worth of scrolling, in ticks per axis */
+struct scroll_event {
+	int8_t wheel;	/* vertical, Wheel usage */
+	int8_t pan;	/* horizontal, AC Pan usage */
+	int16_t dial;	/* dial personality: wheel rotation in 1/16 counts, not quantized */
+	uint16_t angle;	/* dial personality: wheel position in 1/16 counts */
+};
+
+/* Upper bounds of the HID send time histogram buckets, the last bucket takes the rest */
+#define HID_SEND_BUCKET_BOUNDS_US {250, 500, 1000, 2000}
+#define HID_SEND_BUCKETS 5
+
+/* Time spent in the stack's notify call per input report */
+struct hid_send_stats {
+	uint32_t calls;
+	uint32_t batched;	/* calls that notified every host at once */
+	uint32_t errors;
+	uint32_t total_us;
+	uint32_t max_us;
+	uint32_t buckets[HID_SEND_BUCKETS];
+};
+
+void hid_send_stats_get(struct hid_send_stats *stats);
+void hid_send_stats_reset(void);
+
 extern struct k_msgq scroll_queue;
 extern struct k_work hids_work;
 
 extern bool hirez_enabled;
 extern bool bt_connected;
+/* Uptime of the last scroll input, for work that waits for a pause */
+extern int64_t scroll_activity_at;
 
 #endif /* _SCROLL_H_ */
\ No newline at end of file
@@ -0,0 +1,31 @@
+#ifndef _SETTINGS_CACHE_H_
+#define _SETTINGS_CACHE_H_
+
+#include <zephyr/types.h>
+
+struct settings_cache_stats {
+	uint32_t flash_writes;  /* records handed to the storage backend */
+	uint32_t skipped;       /* saves of a value identical to the stored one */
+	uint32_t deferred;      /* saves held in RAM for the next flush */
+	uint32_t flushes;       /* idle flushes that wrote at least one record */
+	uint16_t dirty;         /* records waiting for a flush now */
+	uint16_t uncached;      /* saves written through for lack of a free entry */
+};
+
+#if CONFIG_SCROLL_SETTINGS_CACHE
+/*
+ * Put the cache in front of the storage backend, call after bt_enable() has
+ * initialised settings and before settings_load().
+ */
+int settings_cache_init(void);
+
+/* Write every held record now, before a reset or System OFF */
+void settings_cache_flush(void);
+
+void settings_cache_stats_get(struct settings_cache_stats *stats);
+#else
+static inline int settings_cache_init(void) { return 0; }
+static inline void settings_cache_flush(void) {}
+#endif
+
+#endif /* _SETTINGS_CACHE_H_ */
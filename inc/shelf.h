@@ -0,0 +1,36 @@
+#ifndef _SHELF_H_
+#define _SHELF_H_
+
+#include <zephyr/types.h>
+
+/* A button press starting this soon after a shelf wake is the wake press itself */
+#define SHELF_WAKE_PRESS_MS 1000
+
+#if CONFIG_SCROLL_SHELF
+/* Read the reset reason and the retained state, call first thing in main() */
+void shelf_init(void);
+
+/* True if this boot is a button wake from System OFF with valid retained state */
+bool shelf_woke(void);
+
+/* Count down to System OFF once advertising has given up; cancelled by any activity */
+void shelf_arm(void);
+void shelf_disarm(void);
+
+/* Kept in retained RAM across System OFF */
+void shelf_retain_slot(uint8_t slot);
+void shelf_retain_battery(uint8_t level);
+uint8_t shelf_retained_slot(void);
+uint8_t shelf_retained_battery(void);
+#else
+static inline void shelf_init(void) {}
+static inline bool shelf_woke(void) { return false; }
+static inline void shelf_arm(void) {}
+static inline void shelf_disarm(void) {}
+static inline void shelf_retain_slot(uint8_t slot) {}
+static inline void shelf_retain_battery(uint8_t level) {}
+static inline uint8_t shelf_retained_slot(void) { return 0; }
+static inline uint8_t shelf_retained_battery(void) { return 0; }
+#endif
+
+#endif /* _SHELF_H_ */
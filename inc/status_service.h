@@ -0,0 +1,9 @@
+#ifndef _STATUS_SERVICE_H_
+#define _STATUS_SERVICE_H_
+
+#include "magnetometer.h"
+
+/* Publish a new magnet health snapshot; subscribers are notified when the magnet status changes */
+void status_service_magnet_update(const struct magnet_health *health);
+
+#endif /* _STATUS_SERVICE_H_ */
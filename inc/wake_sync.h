@@ -0,0 +1,20 @@
+#ifndef _WAKE_SYNC_H_
+#define _WAKE_SYNC_H_
+
+#include <zephyr/types.h>
+
+struct wake_sync_stats {
+	uint32_t elapsed_ms;      /* since the last reset */
+	uint32_t radio_events;    /* connection events of all links, 0 if not reported */
+	uint32_t sensor_samples;  /* sensor samples, aligned or not */
+	uint32_t aligned_samples; /* samples started by a connection event of the lead host */
+	uint32_t match_requests;  /* interval updates asked of the other hosts */
+	uint32_t lead_interval_us;
+	uint8_t links;
+	uint8_t matched_links;    /* links on the lead host's interval, the lead included */
+};
+
+void wake_sync_stats_get(struct wake_sync_stats *stats);
+void wake_sync_stats_reset(void);
+
+#endif /* _WAKE_SYNC_H_ */
@@ -7,103 +7,333 @@
 #define DT_DRV_COMPAT zephyr_custom_as5600
 
 #include <errno.h>
+#include <string.h>
 #include <zephyr/sys/__assert.h>
 #include <zephyr/sys/util.h>
+#include <zephyr/kernel.h>
 #include <zephyr/device.h>
 #include <zephyr/init.h>
 #include <zephyr/sys/byteorder.h>
 #include <zephyr/drivers/sensor.h>
 #include <zephyr/drivers/i2c.h>
+#include <zephyr/drivers/regulator.h>
+#include <zephyr/pm/device.h>
+#include <zephyr/pm/device_runtime.h>
 #include <zephyr/logging/log.h>
 #include "custom_as5600.h"
 
-LOG_MODULE_REGISTER(custom_as5600, CONFIG_SENSOR_LOG_LEVEL);
+LOG_MODULE_REGISTER(custom_as5600, CONFIG_CUSTOM_AS5600_LOG_LEVEL);
 
 #define AS5600_ANGLE_REGISTER_H 0x0E
 #define AS5600_ANGLE_REGISTER_RAW_H 0x0C
 #define AS5600_STATUS_REGISTER  0x0B
 #define AS5600_CONF_REGISTER   0x07
+#define AS5600_AGC_REGISTER     0x1A
+#define AS5600_12BIT_MASK       0x0FFF
 #define AS5600_FULL_ANGLE       360
 #define AS5600_PULSES_PER_REV   4096
 #define AS5600_MILLION_UNIT 1000000
+#define AS5600_POWER_UP_MS      10 /* t_PU, power-up to first valid angle */
 
 #define AS5600_STATUS_MH_BIT    (3) /* Magnet too strong */
 #define AS5600_STATUS_ML_BIT    (4) /* Magnet too weak */
 #define AS5600_STATUS_MD_BIT    (5) /* Magnet detected */
 
-typedef union {
-    uint16_t word;
-    struct {
-        uint8_t lsb;
-        uint8_t msb;
-    } bytes;
-    uint8_t raw[2];
-    struct {
-        uint16_t power_mode : 2;
-        uint16_t hysteresis : 2;
-        uint16_t output_stage : 2;
-        uint16_t pwm_freq : 2;
-        uint16_t watchdog : 2;
-        uint16_t slow_filter : 2;
-        uint16_t fast_filter : 2;
-    } bits;
-} as5600_conf_reg_t;
+/* CONF is a big-endian word spanning 0x07 (high byte) and 0x08 (low byte) */
+#define AS5600_CONF_PM_MASK     GENMASK(1, 0)
+#define AS5600_CONF_HYST_MASK   GENMASK(3, 2)
+#define AS5600_CONF_OUTS_MASK   GENMASK(5, 4)
+#define AS5600_CONF_PWMF_MASK   GENMASK(7, 6)
+#define AS5600_CONF_SF_MASK     GENMASK(9, 8)
+#define AS5600_CONF_FTH_MASK    GENMASK(12, 10)
+#define AS5600_CONF_WD_MASK     BIT(13)
+
+#define AS5600_OUTPUT_STAGE_RESERVED 3
 
 struct as5600_dev_cfg {
     struct i2c_dt_spec i2c_port;
+    const struct device *vin; /* optional supply, switched by runtime PM */
 };
 
 /* Device run time data */
 struct as5600_dev_data {
     uint16_t position;
+    uint16_t conf; /* shadow of the last CONF value read or written */
+    bool conf_valid;
+    bool conf_pending; /* the sensor may have lost CONF, write it back at the next chance */
+    uint16_t magnitude;
+    uint8_t agc;
+    enum as5600_magnet_status magnet;
+    int64_t backoff_until;   /* uptime before which the bus is left alone */
+    uint32_t backoff_ms;
+    struct as5600_stats stats;
 };
 
-static int as5600_fetch(const struct device *dev, enum sensor_channel chan)
+/* Write the shadowed CONF back, the bus must be resumed */
+static int as5600_conf_restore(const struct device *dev)
+{
+    struct as5600_dev_data *dev_data = dev->data;
+    const struct as5600_dev_cfg *dev_cfg = dev->config;
+    uint8_t buffer[2];
+    int err;
+
+    if (!dev_data->conf_valid) {
+        dev_data->conf_pending = false;
+        return 0;
+    }
+
+    sys_put_be16(dev_data->conf, buffer);
+    err = i2c_burst_write_dt(&dev_cfg->i2c_port,
+                AS5600_CONF_REGISTER,
+                buffer,
+                sizeof(buffer));
+    if (err != 0) {
+        dev_data->conf_pending = true;
+        return err;
+    }
+
+    dev_data->conf_pending = false;
+    dev_data->stats.conf_restores++;
+
+    return 0;
+}
+
+/*
+ * Re-initialize the bus after the fast retries are exhausted. A hung bus
+ * usually comes with a power glitch on the sensor, which resets CONF, so
+ * the shadowed configuration is written back as well. If that fails, it
+ * is written back after the first transfer that gets through again.
+ */
+static int as5600_recover(const struct device *dev)
 {
     struct as5600_dev_data *dev_data = dev->data;
     const struct as5600_dev_cfg *dev_cfg = dev->config;
 
-    uint8_t status;
-    int err = i2c_reg_read_byte_dt(&dev_cfg->i2c_port,
-                    AS5600_STATUS_REGISTER,
-                    &status);
+    dev_data->stats.bus_recoveries++;
+    dev_data->conf_pending = true;
 
+    int err = i2c_recover_bus(dev_cfg->i2c_port.bus);
+    if (err != 0 && err != -ENOSYS) {
+        LOG_ERR("I2C bus recovery failed: %d", err);
+        dev_data->stats.recovery_failures++;
+        return err;
+    }
+
+    err = as5600_conf_restore(dev);
     if (err != 0) {
-        LOG_ERR("Failed to read status register: %d", err);
+        dev_data->stats.recovery_failures++;
         return err;
     }
 
-    /* Check if the magnet is present */
+    return 0;
+}
+
+/*
+ * A failed transfer is retried CONFIG_CUSTOM_AS5600_RETRIES times, then the
+ * bus is recovered and the transfer attempted once more. If that fails too,
+ * access is suspended with an exponential backoff capped at
+ * CONFIG_CUSTOM_AS5600_BACKOFF_MAX_MS, so a dead bus costs the caller at
+ * most one -EAGAIN per sample meanwhile.
+ */
+static int as5600_transfer_retry(const struct device *dev, uint8_t reg,
+            uint8_t *buf, size_t len, bool write)
+{
+    struct as5600_dev_data *dev_data = dev->data;
+    const struct as5600_dev_cfg *dev_cfg = dev->config;
+    int err = 0;
+
+    for (int attempt = 0; attempt <= CONFIG_CUSTOM_AS5600_RETRIES + 1; attempt++) {
+        if (attempt == CONFIG_CUSTOM_AS5600_RETRIES + 1) {
+            if (as5600_recover(dev) != 0) {
+                break;
+            }
+        } else if (attempt > 0) {
+            k_busy_wait(CONFIG_CUSTOM_AS5600_RETRY_DELAY_US);
+        }
+
+        err = write ? i2c_burst_write_dt(&dev_cfg->i2c_port, reg, buf, len) :
+                      i2c_burst_read_dt(&dev_cfg->i2c_port, reg, buf, len);
+        if (err == 0) {
+            if (attempt > 0) {
+                dev_data->stats.retries++;
+            }
+            dev_data->backoff_ms = 0;
+            return 0;
+        }
+
+        dev_data->stats.i2c_errors++;
+    }
+
+    dev_data->backoff_ms = CLAMP(dev_data->backoff_ms * 2,
+                    CONFIG_CUSTOM_AS5600_BACKOFF_MIN_MS,
+                    CONFIG_CUSTOM_AS5600_BACKOFF_MAX_MS);
+    dev_data->backoff_until = k_uptime_get() + dev_data->backoff_ms;
+
+    return err != 0 ? err : -EIO;
+}
+
+/*
+ * All register access goes through here. The bus is only resumed for the
+ * duration of the transfer, so TWIM is suspended between samples.
+ */
+static int as5600_transfer(const struct device *dev, uint8_t reg,
+            uint8_t *buf, size_t len, bool write)
+{
+    struct as5600_dev_data *dev_data = dev->data;
+    const struct as5600_dev_cfg *dev_cfg = dev->config;
+    int err;
+
+    if (dev_data->backoff_ms != 0 && k_uptime_get() < dev_data->backoff_until) {
+        return -EAGAIN;
+    }
+
+    err = pm_device_runtime_get(dev_cfg->i2c_port.bus);
+    if (err < 0) {
+        return err;
+    }
+
+    err = as5600_transfer_retry(dev, reg, buf, len, write);
+
+    /* Left pending by a recovery that failed, retried on every transfer until it sticks */
+    if (err == 0 && dev_data->conf_pending) {
+        as5600_conf_restore(dev);
+    }
+
+    pm_device_runtime_put(dev_cfg->i2c_port.bus);
+
+    return err;
+}
+
+static inline int as5600_read_regs(const struct device *dev, uint8_t reg,
+            uint8_t *buf, size_t len)
+{
+    return as5600_transfer(dev, reg, buf, len, false);
+}
+
+static inline int as5600_write_regs(const struct device *dev, uint8_t reg,
+            uint8_t *buf, size_t len)
+{
+    return as5600_transfer(dev, reg, buf, len, true);
+}
+
+int as5600_stats_get(const struct device *dev, struct as5600_stats *stats)
+{
+    const struct as5600_dev_data *dev_data = dev->data;
+
+    *stats = dev_data->stats;
+
+    return 0;
+}
+
+static bool as5600_is_health_chan(enum sensor_channel chan)
+{
+    return chan == (enum sensor_channel)AS5600_CHAN_AGC ||
+           chan == (enum sensor_channel)AS5600_CHAN_MAGNITUDE;
+}
+
+static int as5600_fetch_health(const struct device *dev)
+{
+    struct as5600_dev_data *dev_data = dev->data;
+
+    /* AGC is followed by the two MAGNITUDE bytes */
+    uint8_t buffer[3];
+
+    int err = as5600_read_regs(dev,
+                AS5600_AGC_REGISTER,
+                buffer,
+                sizeof(buffer));
+    if (err != 0) {
+        LOG_ERR("Failed to read AGC and magnitude: %d", err);
+        return err;
+    }
+
+    dev_data->agc = buffer[0];
+    dev_data->magnitude = sys_get_be16(&buffer[1]) & AS5600_12BIT_MASK;
+
+    return 0;
+}
+
+static void as5600_update_magnet(struct as5600_dev_data *dev_data, uint8_t status)
+{
+    enum as5600_magnet_status magnet;
+
     if (!(status & BIT(AS5600_STATUS_MD_BIT))) {
-        LOG_WRN("Magnet not detected.");
-        return -ENODATA;
+        magnet = AS5600_MAGNET_MISSING;
+    } else if (status & BIT(AS5600_STATUS_MH_BIT)) {
+        magnet = AS5600_MAGNET_TOO_STRONG;
+    } else if (status & BIT(AS5600_STATUS_ML_BIT)) {
+        magnet = AS5600_MAGNET_TOO_WEAK;
+    } else {
+        magnet = AS5600_MAGNET_OK;
     }
 
-    /* Check if the magnet is too strong or too weak */
-    if (status & BIT(AS5600_STATUS_MH_BIT)) {
-        LOG_WRN("Magnet too strong.");
-        return -ENODATA;
+    /* Only log transitions, this runs at the sample rate */
+    if (magnet != dev_data->magnet) {
+        switch (magnet) {
+            case AS5600_MAGNET_MISSING:
+                LOG_WRN("Magnet not detected.");
+                break;
+            case AS5600_MAGNET_TOO_STRONG:
+                LOG_WRN("Magnet too strong.");
+                break;
+            case AS5600_MAGNET_TOO_WEAK:
+                LOG_WRN("Magnet too weak.");
+                break;
+            default:
+                LOG_INF("Magnet field in range.");
+                break;
+        }
+        dev_data->magnet = magnet;
     }
+}
 
-    if (status & BIT(AS5600_STATUS_ML_BIT)) {
-        LOG_WRN("Magnet too weak.");
-        return -ENODATA;
+static int as5600_fetch(const struct device *dev, enum sensor_channel chan)
+{
+    struct as5600_dev_data *dev_data = dev->data;
+    int err;
+
+    if (chan != SENSOR_CHAN_ALL && chan != SENSOR_CHAN_ROTATION &&
+        chan != (enum sensor_channel)AS5600_CHAN_MAGNET_STATUS &&
+        !as5600_is_health_chan(chan)) {
+        return -ENOTSUP;
+    }
+
+    if (chan == SENSOR_CHAN_ALL || as5600_is_health_chan(chan)) {
+        err = as5600_fetch_health(dev);
+        if (err != 0 || chan != SENSOR_CHAN_ALL) {
+            return err;
+        }
     }
 
-    uint8_t buffer[2] = {0, 0};
+    /* STATUS is followed by the two RAW ANGLE bytes, read them in one transfer */
+    uint8_t buffer[3];
 
-    err = i2c_burst_read_dt(&dev_cfg->i2c_port,
-                AS5600_ANGLE_REGISTER_RAW_H,
-                (uint8_t *) &buffer,
+    err = as5600_read_regs(dev,
+                AS5600_STATUS_REGISTER,
+                buffer,
                 sizeof(buffer));
+    if (err != 0) {
+        /* invalid readings preserves the last good value */
+        if (err != -EAGAIN) {
+            LOG_ERR("Failed to read status and angle: %d", err);
+        }
+        return err;
+    }
+
+    as5600_update_magnet(dev_data, buffer[0]);
 
-    /* invalid readings preserves the last good value */
-    uint16_t position = sys_get_be16(buffer);
-    if (!err) {
-        dev_data->position = position;
+    /*
+     * Without a magnet the angle is meaningless. A magnet outside the
+     * recommended field range still yields a usable angle, so it is kept
+     * and left to the caller to judge via AS5600_CHAN_MAGNET_STATUS.
+     */
+    if (dev_data->magnet == AS5600_MAGNET_MISSING) {
+        return -ENODATA;
     }
 
-    return err;
+    dev_data->position = sys_get_be16(&buffer[1]) & AS5600_12BIT_MASK;
+
+    return 0;
 }
 
 static int as5600_get(const struct device *dev, enum sensor_channel chan,
@@ -111,114 +341,264 @@ static int as5600_get(const struct device *dev, enum sensor_channel chan,
 {
     struct as5600_dev_data *dev_data = dev->data;
 
-    if (chan == SENSOR_CHAN_ROTATION) {
-        val->val1 = ((int32_t)dev_data->position * AS5600_FULL_ANGLE) /
-                            AS5600_PULSES_PER_REV;
+    switch ((int)chan) {
+        case SENSOR_CHAN_ROTATION:
+            val->val1 = ((int32_t)dev_data->position * AS5600_FULL_ANGLE) /
+                                AS5600_PULSES_PER_REV;
+
+            val->val2 = (((int32_t)dev_data->position * AS5600_FULL_ANGLE) %
+                     AS5600_PULSES_PER_REV) * (AS5600_MILLION_UNIT / AS5600_PULSES_PER_REV);
+            break;
+
+        case AS5600_CHAN_AGC:
+            val->val1 = dev_data->agc;
+            val->val2 = 0;
+            break;
+
+        case AS5600_CHAN_MAGNITUDE:
+            val->val1 = dev_data->magnitude;
+            val->val2 = 0;
+            break;
+
+        case AS5600_CHAN_MAGNET_STATUS:
+            val->val1 = dev_data->magnet;
+            val->val2 = 0;
+            break;
+
+        case AS5600_CHAN_RAW_ANGLE:
+            val->val1 = dev_data->position;
+            val->val2 = 0;
+            break;
+
+        default:
+            return -ENOTSUP;
+    }
 
-        val->val2 = (((int32_t)dev_data->position * AS5600_FULL_ANGLE) %
-                 AS5600_PULSES_PER_REV) * (AS5600_MILLION_UNIT / AS5600_PULSES_PER_REV);
-        if (val->val1 > 360) {
-            printk("\n\nInvalid position value: %x\n\n", dev_data->position);
-        }
-    } else {
-        return -ENOTSUP;
+    return 0;
+}
+
+static uint16_t as5600_attr_mask(enum sensor_attribute attr)
+{
+    switch ((enum as5600_attributes)attr) {
+        case AS5600_POWER_MODE:
+            return AS5600_CONF_PM_MASK;
+        case AS5600_HYSTERESIS:
+            return AS5600_CONF_HYST_MASK;
+        case AS5600_OUTPUT_STAGE:
+            return AS5600_CONF_OUTS_MASK;
+        case AS5600_PWM_FREQUENCY:
+            return AS5600_CONF_PWMF_MASK;
+        case AS5600_WATCHDOG:
+            return AS5600_CONF_WD_MASK;
+        case AS5600_SLOW_FILTER:
+            return AS5600_CONF_SF_MASK;
+        case AS5600_FAST_FILTER:
+            return AS5600_CONF_FTH_MASK;
+        default:
+            return 0;
+    }
+}
+
+static int as5600_conf_read(const struct device *dev, uint16_t *conf)
+{
+    struct as5600_dev_data *dev_data = dev->data;
+    uint8_t buffer[2];
+
+    int err = as5600_read_regs(dev,
+                AS5600_CONF_REGISTER,
+                buffer,
+                sizeof(buffer));
+    if (err != 0) {
+        LOG_ERR("Failed to read config register: %d", err);
+        return err;
     }
 
+    *conf = sys_get_be16(buffer);
+    dev_data->conf = *conf;
+    dev_data->conf_valid = true;
+
     return 0;
 }
 
-int as5600_attr_set(const struct device *dev, enum sensor_channel chan, enum sensor_attribute attr, const struct sensor_value *val)
-{
-    if (chan == SENSOR_CHAN_ROTATION) {
-        enum as5600_attributes as_attr = (enum as5600_attributes)attr;
-        switch (as_attr) {
-            case AS5600_POWER_MODE:
-                {
-                    as5600_conf_reg_t conf_reg;
-                    const struct as5600_dev_cfg *dev_cfg = dev->config;
-
-                    int err = i2c_burst_read_dt(&dev_cfg->i2c_port,
-                                AS5600_CONF_REGISTER,
-                                (uint8_t *)&conf_reg,
-                                sizeof(conf_reg));
-                    if (err != 0) {
-                        LOG_ERR("Failed to read config register: %d", err);
-                        return err;
-                    }
-
-                    conf_reg.bits.power_mode = val->val1;
-
-                    err = i2c_burst_write_dt(&dev_cfg->i2c_port,
-                                AS5600_CONF_REGISTER,
-                                (uint8_t *)&conf_reg,
-                                sizeof(conf_reg));
-                    if (err != 0) {
-                        LOG_ERR("Failed to write config register: %d", err);
-                        return err;
-                    }
-                }
-                break;
+static int as5600_conf_write(const struct device *dev, uint16_t conf)
+{
+    struct as5600_dev_data *dev_data = dev->data;
+    uint8_t buffer[2];
 
-            case AS5600_HYSTERESIS:
-            {
-                as5600_conf_reg_t conf_reg;
-                const struct as5600_dev_cfg *dev_cfg = dev->config;
-
-                int err = i2c_burst_read_dt(&dev_cfg->i2c_port,
-                            AS5600_CONF_REGISTER,
-                            (uint8_t *)&conf_reg,
-                            sizeof(conf_reg));
-                if (err != 0) {
-                    LOG_ERR("Failed to read config register: %d", err);
-                    return err;
-                }
-
-                conf_reg.bits.hysteresis = val->val1;
-
-                err = i2c_burst_write_dt(&dev_cfg->i2c_port,
-                            AS5600_CONF_REGISTER,
-                            (uint8_t *)&conf_reg,
-                            sizeof(conf_reg));
-                if (err != 0) {
-                    LOG_ERR("Failed to write config register: %d", err);
-                    return err;
-                }
-            }break;
+    sys_put_be16(conf, buffer);
 
-            default:
-                return -ENOTSUP;
-        }
-    } else {
+    int err = as5600_write_regs(dev,
+                AS5600_CONF_REGISTER,
+                buffer,
+                sizeof(buffer));
+    if (err != 0) {
+        LOG_ERR("Failed to write config register: %d", err);
+        return err;
+    }
+
+    dev_data->conf = conf;
+    dev_data->conf_valid = true;
+
+    return 0;
+}
+
+static int as5600_attr_set(const struct device *dev, enum sensor_channel chan, enum sensor_attribute attr, const struct sensor_value *val)
+{
+    if (chan != SENSOR_CHAN_ROTATION) {
         return -ENOTSUP;
     }
+
+    uint16_t mask = as5600_attr_mask(attr);
+
+    if (mask == 0) {
+        return -ENOTSUP;
+    }
+
+    /* FIELD_GET(mask, mask) is the largest value the field can hold */
+    if (val->val1 < 0 || val->val1 > FIELD_GET(mask, mask)) {
+        return -EINVAL;
+    }
+
+    if ((enum as5600_attributes)attr == AS5600_OUTPUT_STAGE &&
+        val->val1 == AS5600_OUTPUT_STAGE_RESERVED) {
+        return -EINVAL;
+    }
+
+    uint16_t conf;
+    int err = as5600_conf_read(dev, &conf);
+
+    if (err != 0) {
+        return err;
+    }
+
+    uint16_t new_conf = (conf & ~mask) | FIELD_PREP(mask, val->val1);
+
+    if (new_conf == conf) {
+        return 0;
+    }
+
+    return as5600_conf_write(dev, new_conf);
+}
+
+static int as5600_attr_get(const struct device *dev, enum sensor_channel chan, enum sensor_attribute attr, struct sensor_value *val)
+{
+    if (chan != SENSOR_CHAN_ROTATION) {
+        return -ENOTSUP;
+    }
+
+    uint16_t mask = as5600_attr_mask(attr);
+
+    if (mask == 0) {
+        return -ENOTSUP;
+    }
+
+    /* Read back from the chip so callers can verify what was applied */
+    uint16_t conf;
+    int err = as5600_conf_read(dev, &conf);
+
+    if (err != 0) {
+        return err;
+    }
+
+    val->val1 = FIELD_GET(mask, conf);
+    val->val2 = 0;
+
     return 0;
 }
 
+/*
+ * Suspend removes the sensor's supply, which resets CONF. Resume powers it
+ * back up and writes the shadowed configuration, so callers find the
+ * settings they left the device with.
+ */
+static int as5600_pm_action(const struct device *dev, enum pm_device_action action)
+{
+    struct as5600_dev_data *dev_data = dev->data;
+    const struct as5600_dev_cfg *dev_cfg = dev->config;
+    int err;
+
+    switch (action) {
+    case PM_DEVICE_ACTION_RESUME:
+        if (dev_cfg->vin != NULL) {
+            err = regulator_enable(dev_cfg->vin);
+            if (err != 0) {
+                return err;
+            }
+            k_sleep(K_MSEC(AS5600_POWER_UP_MS));
+        }
+
+        if (dev_data->conf_valid) {
+            uint8_t buffer[2];
+
+            sys_put_be16(dev_data->conf, buffer);
+            err = as5600_write_regs(dev, AS5600_CONF_REGISTER, buffer, sizeof(buffer));
+            if (err != 0) {
+                /* Powered but unconfigured, the next attr_set fixes it */
+                LOG_WRN("Failed to restore CONF on resume: %d", err);
+            } else {
+                dev_data->stats.conf_restores++;
+            }
+        }
+        return 0;
+    case PM_DEVICE_ACTION_SUSPEND:
+        if (dev_cfg->vin != NULL) {
+            return regulator_disable(dev_cfg->vin);
+        }
+        return 0;
+    case PM_DEVICE_ACTION_TURN_ON:
+    case PM_DEVICE_ACTION_TURN_OFF:
+        return 0;
+    default:
+        return -ENOTSUP;
+    }
+}
+
 static int as5600_initialize(const struct device *dev)
 {
     struct as5600_dev_data *const dev_data = dev->data;
+    const struct as5600_dev_cfg *dev_cfg = dev->config;
 
     dev_data->position = 0;
+    dev_data->conf = 0;
+    dev_data->conf_valid = false;
+    dev_data->conf_pending = false;
+    dev_data->backoff_until = 0;
+    dev_data->backoff_ms = 0;
+    memset(&dev_data->stats, 0, sizeof(dev_data->stats));
+    dev_data->magnitude = 0;
+    dev_data->agc = 0;
+    dev_data->magnet = AS5600_MAGNET_OK;
+
+    if (dev_cfg->vin != NULL && !device_is_ready(dev_cfg->vin)) {
+        LOG_ERR("Supply %s is not ready", dev_cfg->vin->name);
+        return -ENODEV;
+    }
 
     LOG_INF("Device %s initialized", dev->name);
 
-    return 0;
+    /* Stays suspended, and unpowered, until the first pm_device_runtime_get() */
+    return pm_device_driver_init(dev, as5600_pm_action);
 }
 
 static const struct sensor_driver_api as5600_driver_api = {
 	.sample_fetch = as5600_fetch,
 	.channel_get = as5600_get,
     .attr_set = as5600_attr_set,
-    .attr_get = NULL,
+    .attr_get = as5600_attr_get,
 };
 
 #define AS5600_INIT(n)						\
 	static struct as5600_dev_data as5600_data##n;		\
 	static const struct as5600_dev_cfg as5600_cfg##n = {\
-		.i2c_port = I2C_DT_SPEC_INST_GET(n)	\
+		.i2c_port = I2C_DT_SPEC_INST_GET(n),	\
+		.vin = COND_CODE_1(DT_INST_NODE_HAS_PROP(n, vin_supply),	\
+				   (DEVICE_DT_GET(DT_INST_PHANDLE(n, vin_supply))),	\
+				   (NULL)),	\
 	};	\
 									\
-	SENSOR_DEVICE_DT_INST_DEFINE(n, as5600_initialize, NULL,	\
+	PM_DEVICE_DT_INST_DEFINE(n, as5600_pm_action);		\
+									\
+	SENSOR_DEVICE_DT_INST_DEFINE(n, as5600_initialize, PM_DEVICE_DT_INST_GET(n),	\
 			    &as5600_data##n, &as5600_cfg##n, \
 			    POST_KERNEL, CONFIG_SENSOR_INIT_PRIORITY,	\
 			    &as5600_driver_api);
@@ -0,0 +1,146 @@
+/*
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#define DT_DRV_COMPAT zephyr_custom_as5600
+
+#include <errno.h>
+#include <string.h>
+#include <zephyr/device.h>
+#include <zephyr/drivers/emul.h>
+#include <zephyr/drivers/i2c.h>
+#include <zephyr/drivers/i2c_emul.h>
+#include <zephyr/sys/byteorder.h>
+#include <zephyr/sys/util.h>
+#include <zephyr/logging/log.h>
+#include "custom_as5600_emul.h"
+
+LOG_MODULE_REGISTER(custom_as5600_emul, CONFIG_CUSTOM_AS5600_LOG_LEVEL);
+
+#define AS5600_EMUL_REG_COUNT   0x100
+#define AS5600_EMUL_CONF_H      0x07
+#define AS5600_EMUL_STATUS      0x0B
+#define AS5600_EMUL_RAW_ANGLE_H 0x0C
+#define AS5600_EMUL_ANGLE_H     0x0E
+#define AS5600_EMUL_AGC         0x1A
+#define AS5600_EMUL_MAGNITUDE_H 0x1B
+
+#define AS5600_EMUL_STATUS_MD   BIT(5)
+
+struct as5600_emul_data {
+    uint8_t regs[AS5600_EMUL_REG_COUNT];
+    uint32_t fault_count;
+    uint32_t nacked;
+};
+
+static int as5600_emul_transfer(const struct emul *target, struct i2c_msg *msgs,
+                int num_msgs, int addr)
+{
+    struct as5600_emul_data *data = target->data;
+    bool have_reg = false;
+    uint8_t reg = 0;
+
+    ARG_UNUSED(addr);
+
+    if (data->fault_count > 0) {
+        data->fault_count--;
+        data->nacked++;
+        return -EIO;
+    }
+
+    for (int i = 0; i < num_msgs; i++) {
+        struct i2c_msg *msg = &msgs[i];
+        uint32_t start = 0;
+
+        if ((msg->flags & I2C_MSG_RW_MASK) == I2C_MSG_READ) {
+            for (uint32_t j = 0; j < msg->len; j++) {
+                msg->buf[j] = data->regs[reg++];
+            }
+            continue;
+        }
+
+        /* The first byte written in a transaction is the register address */
+        if (!have_reg) {
+            if (msg->len == 0) {
+                continue;
+            }
+            reg = msg->buf[0];
+            have_reg = true;
+            start = 1;
+        }
+
+        for (uint32_t j = start; j < msg->len; j++) {
+            data->regs[reg++] = msg->buf[j];
+        }
+    }
+
+    return 0;
+}
+
+static const struct i2c_emul_api as5600_emul_api = {
+    .transfer = as5600_emul_transfer,
+};
+
+void as5600_emul_inject_fault(const struct emul *target, enum as5600_emul_fault fault,
+                  uint32_t count)
+{
+    struct as5600_emul_data *data = target->data;
+
+    if (fault == AS5600_EMUL_FAULT_POWER_LOSS) {
+        data->regs[AS5600_EMUL_CONF_H] = 0;
+        data->regs[AS5600_EMUL_CONF_H + 1] = 0;
+    }
+
+    data->fault_count = (fault == AS5600_EMUL_FAULT_NONE) ? 0 : count;
+}
+
+uint32_t as5600_emul_nacked_transfers(const struct emul *target)
+{
+    const struct as5600_emul_data *data = target->data;
+
+    return data->nacked;
+}
+
+void as5600_emul_set_raw_angle(const struct emul *target, uint16_t raw_angle)
+{
+    struct as5600_emul_data *data = target->data;
+
+    /* No ZPOS/MPOS programmed, so ANGLE follows RAW ANGLE */
+    sys_put_be16(raw_angle & 0x0FFF, &data->regs[AS5600_EMUL_RAW_ANGLE_H]);
+    sys_put_be16(raw_angle & 0x0FFF, &data->regs[AS5600_EMUL_ANGLE_H]);
+}
+
+void as5600_emul_set_status(const struct emul *target, uint8_t status)
+{
+    struct as5600_emul_data *data = target->data;
+
+    data->regs[AS5600_EMUL_STATUS] = status;
+}
+
+uint16_t as5600_emul_get_conf(const struct emul *target)
+{
+    const struct as5600_emul_data *data = target->data;
+
+    return sys_get_be16(&data->regs[AS5600_EMUL_CONF_H]);
+}
+
+static int as5600_emul_init(const struct emul *target, const struct device *parent)
+{
+    struct as5600_emul_data *data = target->data;
+
+    ARG_UNUSED(parent);
+
+    memset(data, 0, sizeof(*data));
+    data->regs[AS5600_EMUL_STATUS] = AS5600_EMUL_STATUS_MD;
+    data->regs[AS5600_EMUL_AGC] = 0x80;
+    sys_put_be16(0x0800, &data->regs[AS5600_EMUL_MAGNITUDE_H]);
+
+    return 0;
+}
+
+#define AS5600_EMUL(n)                                              \
+    static struct as5600_emul_data as5600_emul_data_##n;           \
+    EMUL_DT_INST_DEFINE(n, as5600_emul_init, &as5600_emul_data_##n, \
+                NULL, &as5600_emul_api, NULL);
+
+DT_INST_FOREACH_STATUS_OKAY(AS5600_EMUL)
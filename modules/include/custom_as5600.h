@@ -17,6 +17,20 @@ enum as5600_attributes {
     AS5600_FAST_FILTER,
 };
 
+enum as5600_channels {
+    AS5600_CHAN_AGC = SENSOR_CHAN_PRIV_START, /* automatic gain control, 0..255 */
+    AS5600_CHAN_MAGNITUDE,                    /* CORDIC magnitude, 12 bit */
+    AS5600_CHAN_MAGNET_STATUS,                /* enum as5600_magnet_status of the last angle fetch */
+    AS5600_CHAN_RAW_ANGLE,                    /* counts of the last angle fetch, 0..4095 */
+};
+
+enum as5600_magnet_status {
+    AS5600_MAGNET_OK = 0,
+    AS5600_MAGNET_TOO_WEAK = 1,
+    AS5600_MAGNET_TOO_STRONG = 2,
+    AS5600_MAGNET_MISSING = 3,
+};
+
 enum as5600_power_mode {
     AS5600_POWER_MODE_NOM = 0,
     AS5600_POWER_MODE_LPM1 = 1,
@@ -67,6 +81,17 @@ enum as5600_fast_filter {
     AS5600_FAST_FILTER_10LSB = 7,
 };
 
+/* I2C error and recovery counters, see as5600_stats_get() */
+struct as5600_stats {
+    uint32_t i2c_errors;        /* failed transfers, including retried ones */
+    uint32_t retries;           /* transfers that succeeded after a retry or recovery */
+    uint32_t bus_recoveries;    /* i2c_recover_bus() attempts */
+    uint32_t recovery_failures; /* recoveries that did not bring the sensor back */
+    uint32_t conf_restores;     /* shadowed CONF written back after a recovery */
+};
+
+int as5600_stats_get(const struct device *dev, struct as5600_stats *stats);
+
 #ifdef __cplusplus
 }
 #endif
@@ -0,0 +1,33 @@
+#ifndef CUSTOM_AS5600_EMUL_H_
+#define CUSTOM_AS5600_EMUL_H_
+
+#include <zephyr/drivers/emul.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+enum as5600_emul_fault {
+    AS5600_EMUL_FAULT_NONE = 0,
+    /* NACK the next transfers, as a hung or glitching bus would */
+    AS5600_EMUL_FAULT_NACK,
+    /* Power glitch: CONF is cleared, then the next transfers are NACKed */
+    AS5600_EMUL_FAULT_POWER_LOSS,
+};
+
+/* Inject a fault covering the next count bus transfers */
+void as5600_emul_inject_fault(const struct emul *target, enum as5600_emul_fault fault,
+                  uint32_t count);
+
+/* Transfers NACKed by fault injection so far */
+uint32_t as5600_emul_nacked_transfers(const struct emul *target);
+
+void as5600_emul_set_raw_angle(const struct emul *target, uint16_t raw_angle);
+void as5600_emul_set_status(const struct emul *target, uint8_t status);
+uint16_t as5600_emul_get_conf(const struct emul *target);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* CUSTOM_AS5600_EMUL_H_ */
@@ -0,0 +1,44 @@
+#include <zephyr/kernel.h>
+#include <zephyr/sys/atomic.h>
+#include <zephyr/logging/log.h>
+
+#include "boot_profile.h"
+
+LOG_MODULE_REGISTER(boot_profile, CONFIG_SCROLL_LOG_LEVEL);
+
+static const char *const stage_names[BOOT_STAGE_COUNT] = {
+	[BOOT_STAGE_MAIN] = "main",
+	[BOOT_STAGE_BT_ENABLE] = "bt_enable",
+	[BOOT_STAGE_BT_READY] = "bt_ready",
+	[BOOT_STAGE_SETTINGS] = "settings",
+	[BOOT_STAGE_ADV] = "advertising",
+	[BOOT_STAGE_PERIPHERALS] = "peripherals",
+	[BOOT_STAGE_SENSOR] = "sensor",
+};
+
+static uint32_t stage_us[BOOT_STAGE_COUNT];
+static ATOMIC_DEFINE(stage_marked, BOOT_STAGE_COUNT);
+
+void boot_profile_mark(enum boot_stage stage)
+{
+	if (stage >= BOOT_STAGE_COUNT || atomic_test_and_set_bit(stage_marked, stage)) {
+		return;
+	}
+
+	/*
+	 * The system clock starts in PRE_KERNEL_2, so this misses only the
+	 * early SoC and C runtime setup after reset or wake.
+	 */
+	stage_us[stage] = (uint32_t)k_ticks_to_us_floor64(k_uptime_ticks());
+
+	LOG_INF("boot: %s at %u us", stage_names[stage], stage_us[stage]);
+}
+
+uint32_t boot_profile_get_us(enum boot_stage stage)
+{
+	if (stage >= BOOT_STAGE_COUNT || !atomic_test_bit(stage_marked, stage)) {
+		return 0;
+	}
+
+	return stage_us[stage];
+}
@@ -0,0 +1,526 @@
+#include <zephyr/kernel.h>
+#include <zephyr/settings/settings.h>
+#include <zephyr/shell/shell.h>
+#include <zephyr/logging/log.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "calibration.h"
+
+LOG_MODULE_REGISTER(calibration, CONFIG_MAGNETOMETER_LOG_LEVEL);
+
+#define CAL_COUNTS 4096
+#define CAL_NODE_COUNTS (CAL_COUNTS / CAL_TABLE_SIZE)
+/* Positions are handled in 1/16 counts so the correction keeps sub-LSB detail */
+#define CAL_FRAC_BITS 4
+#define CAL_FULL_TURN (CAL_COUNTS << CAL_FRAC_BITS)
+/* A step backward larger than this is a reversal rather than noise */
+#define CAL_REVERSAL (4 << CAL_FRAC_BITS)
+
+enum {
+	CAL_RAW,
+	CAL_CORRECTED,
+	CAL_KINDS
+};
+
+struct cal_table {
+	bool valid;
+	int16_t node[CAL_TABLE_SIZE];	/* correction at the centre of each node, 1/16 counts */
+};
+
+static const char *const cal_axis_names[AXIS_COUNT] = {
+	[AXIS_WHEEL] = "wheel",
+	[AXIS_PAN] = "pan",
+};
+
+static struct cal_table cal_tables[AXIS_COUNT];
+/* Axis of the current or last run */
+static enum scroll_axis_id cal_axis;
+/* Bit per axis whose table is waiting to be stored */
+static atomic_t cal_save_axes;
+/*
+ * Held by the sensor thread for each calibration sample, and by the shell
+ * and the storage work while they start, stop or read a run or a table
+ */
+static K_MUTEX_DEFINE(cal_lock);
+
+#if CONFIG_SCROLL_CALIBRATION_LEARN
+/*
+ * Sums over one revolution. A constant speed makes the position a linear
+ * function of time since the zero crossing, so the deviation of every sample
+ * follows from these sums once the revolution time is known.
+ */
+struct cal_revolution {
+	uint32_t n;
+	bool broken;			/* reversed somewhere in this revolution */
+	double sdt;			/* us since the crossing */
+	double sdt2;
+	double sp[CAL_KINDS];		/* progress since the crossing, 1/16 counts */
+	double sp2[CAL_KINDS];
+	double sdtp[CAL_KINDS];
+	uint16_t node_n[CAL_TABLE_SIZE];
+	float node_dt[CAL_TABLE_SIZE];
+	float node_p[CAL_TABLE_SIZE];
+};
+
+static atomic_t cal_state;
+static struct cal_report cal_result;
+
+/* Only touched by the sensor thread while a run is active */
+static struct {
+	bool have_prev;
+	uint16_t prev_pos;
+	uint32_t prev_cycles;
+	bool in_rev;
+	int8_t dir;
+	uint32_t cross_cycles;
+	uint32_t prev_period_us;
+	double var_sum[CAL_KINDS];
+	float node_err[CAL_TABLE_SIZE];
+	uint32_t node_n[CAL_TABLE_SIZE];
+	struct cal_revolution rev;
+} run;
+#endif /* CONFIG_SCROLL_CALIBRATION_LEARN */
+
+static void cal_save_handler(struct k_work *work)
+{
+#if CONFIG_SETTINGS
+	for (size_t axis = 0; axis < AXIS_COUNT; axis++) {
+		struct cal_table table;
+		char key[16];
+
+		if (!atomic_test_and_clear_bit(&cal_save_axes, axis)) {
+			continue;
+		}
+
+		k_mutex_lock(&cal_lock, K_FOREVER);
+		table = cal_tables[axis];
+		k_mutex_unlock(&cal_lock);
+
+		snprintk(key, sizeof(key), "cal/%s", cal_axis_names[axis]);
+		if (table.valid) {
+			settings_save_one(key, table.node, sizeof(table.node));
+		} else {
+			settings_delete(key);
+		}
+	}
+#endif
+}
+
+static K_WORK_DEFINE(cal_save_work, cal_save_handler);
+
+static void cal_save(enum scroll_axis_id axis)
+{
+	atomic_set_bit(&cal_save_axes, axis);
+	k_work_submit(&cal_save_work);
+}
+
+#if CONFIG_SETTINGS
+static int cal_settings_set(const char *name, size_t len,
+			    settings_read_cb read_cb, void *cb_arg)
+{
+	for (size_t axis = 0; axis < AXIS_COUNT; axis++) {
+		int rc;
+
+		if (!settings_name_steq(name, cal_axis_names[axis], NULL)) {
+			continue;
+		}
+
+		if (len != sizeof(cal_tables[axis].node)) {
+			return -EINVAL;
+		}
+
+		rc = read_cb(cb_arg, cal_tables[axis].node, sizeof(cal_tables[axis].node));
+		if (rc < 0) {
+			return rc;
+		}
+
+		cal_tables[axis].valid = true;
+		return 0;
+	}
+
+	return -ENOENT;
+}
+
+SETTINGS_STATIC_HANDLER_DEFINE(calibration, "cal", NULL, cal_settings_set, NULL, NULL);
+#endif
+
+uint16_t calibration_correct(enum scroll_axis_id axis, uint16_t raw)
+{
+	const struct cal_table *table = &cal_tables[axis];
+	uint32_t x;
+	uint32_t i;
+	int32_t c0;
+	int32_t c1;
+
+	if (!table->valid) {
+		return raw << CAL_FRAC_BITS;
+	}
+
+	/* Nodes sit at the centre of each 128-count span, wrapping around zero */
+	x = (raw + CAL_COUNTS - CAL_NODE_COUNTS / 2) % CAL_COUNTS;
+	i = x / CAL_NODE_COUNTS;
+	c0 = table->node[i];
+	c1 = table->node[(i + 1) % CAL_TABLE_SIZE];
+
+	return (uint16_t)((raw << CAL_FRAC_BITS) +
+			  c0 + ((c1 - c0) * (int32_t)(x % CAL_NODE_COUNTS)) / CAL_NODE_COUNTS);
+}
+
+int calibration_clear(enum scroll_axis_id axis)
+{
+	if (axis >= AXIS_COUNT) {
+		return -EINVAL;
+	}
+
+	/* Recursive: calibration_running() takes the lock as well */
+	k_mutex_lock(&cal_lock, K_FOREVER);
+	if (calibration_running(axis)) {
+		k_mutex_unlock(&cal_lock);
+		return -EBUSY;
+	}
+	cal_tables[axis].valid = false;
+	k_mutex_unlock(&cal_lock);
+	cal_save(axis);
+
+	return 0;
+}
+
+#if CONFIG_SCROLL_CALIBRATION_LEARN
+static uint16_t rms_mlsb(double var_sum, uint32_t revolutions)
+{
+	double var = var_sum / revolutions;
+	double mlsb;
+
+	if (var <= 0.0) {
+		return 0;
+	}
+
+	mlsb = sqrt(var) * 1000.0 / (1 << CAL_FRAC_BITS);
+
+	return mlsb > UINT16_MAX ? UINT16_MAX : (uint16_t)mlsb;
+}
+
+static void run_finish(void)
+{
+	struct cal_table table = { .valid = true };
+	float err[CAL_TABLE_SIZE];
+	float mean = 0.f;
+
+	if (atomic_get(&cal_state) == CAL_VERIFYING) {
+		LOG_INF("Calibration check of %s: %u -> %u mLSB rms", cal_axis_names[cal_axis],
+			cal_result.raw_rms_mlsb, cal_result.corrected_rms_mlsb);
+		atomic_set(&cal_state, CAL_IDLE);
+		return;
+	}
+
+	for (size_t i = 0; i < CAL_TABLE_SIZE; i++) {
+		if (run.node_n[i] < CAL_MIN_NODE_SAMPLES) {
+			LOG_WRN("Calibration failed, node %zu got %u samples, spin slower",
+				i, run.node_n[i]);
+			atomic_set(&cal_state, CAL_IDLE);
+			return;
+		}
+		err[i] = run.node_err[i] / run.node_n[i];
+		mean += err[i];
+	}
+	mean /= CAL_TABLE_SIZE;
+
+	/* A constant offset is only a different zero, keep the table centred */
+	for (size_t i = 0; i < CAL_TABLE_SIZE; i++) {
+		float node = roundf(err[i] - mean);
+
+		table.node[i] = (int16_t)CLAMP(node, INT16_MIN, INT16_MAX);
+	}
+
+	cal_tables[cal_axis] = table;
+	cal_save(cal_axis);
+
+	LOG_INF("Calibration of %s stored, uncorrected %u mLSB rms", cal_axis_names[cal_axis],
+		cal_result.raw_rms_mlsb);
+	atomic_set(&cal_state, CAL_IDLE);
+}
+
+static void revolution_begin(uint32_t cross_cycles, int8_t dir)
+{
+	if (dir != run.dir) {
+		run.prev_period_us = 0;
+	}
+
+	memset(&run.rev, 0, sizeof(run.rev));
+	run.in_rev = true;
+	run.dir = dir;
+	run.cross_cycles = cross_cycles;
+}
+
+static void revolution_end(uint32_t cross_cycles)
+{
+	struct cal_revolution *rev = &run.rev;
+	uint32_t period = k_cyc_to_us_near32(cross_cycles - run.cross_cycles);
+	uint32_t prev = run.prev_period_us;
+	double a;
+
+	run.prev_period_us = period;
+
+	/* The first revolution has nothing to compare its speed with */
+	if (prev == 0) {
+		return;
+	}
+
+	if (rev->broken || rev->n < CAL_TABLE_SIZE ||
+	    (uint32_t)abs((int32_t)(period - prev)) * 100U > prev * CAL_SPEED_TOLERANCE_PCT) {
+		cal_result.rejected++;
+		return;
+	}
+
+	/* Progress per us at this revolution's speed */
+	a = (double)CAL_FULL_TURN / period;
+
+	for (size_t k = 0; k < CAL_KINDS; k++) {
+		double se = a * rev->sdt - rev->sp[k];
+		double se2 = a * a * rev->sdt2 - 2.0 * a * rev->sdtp[k] + rev->sp2[k];
+		double mean = se / rev->n;
+
+		run.var_sum[k] += se2 / rev->n - mean * mean;
+	}
+
+	for (size_t i = 0; i < CAL_TABLE_SIZE; i++) {
+		if (rev->node_n[i] == 0) {
+			continue;
+		}
+		/* Expected minus measured, turned back into the raw count direction */
+		run.node_err[i] += run.dir * (float)(a * rev->node_dt[i] - rev->node_p[i]);
+		run.node_n[i] += rev->node_n[i];
+	}
+
+	cal_result.revolutions++;
+	cal_result.raw_rms_mlsb = rms_mlsb(run.var_sum[CAL_RAW], cal_result.revolutions);
+	cal_result.corrected_rms_mlsb = rms_mlsb(run.var_sum[CAL_CORRECTED], cal_result.revolutions);
+
+	if (cal_result.revolutions >= CAL_REVOLUTIONS) {
+		run_finish();
+	}
+}
+
+static void revolution_add(uint16_t pos, uint32_t cycles)
+{
+	struct cal_revolution *rev = &run.rev;
+	uint16_t corrected = calibration_correct(cal_axis, pos >> CAL_FRAC_BITS);
+	size_t node = (pos >> CAL_FRAC_BITS) / CAL_NODE_COUNTS;
+	double dt = k_cyc_to_us_near32(cycles - run.cross_cycles);
+	double p[CAL_KINDS];
+
+	p[CAL_RAW] = run.dir > 0 ? pos : CAL_FULL_TURN - pos;
+	p[CAL_CORRECTED] = p[CAL_RAW] + run.dir * (int16_t)(corrected - pos);
+
+	rev->n++;
+	rev->sdt += dt;
+	rev->sdt2 += dt * dt;
+	for (size_t k = 0; k < CAL_KINDS; k++) {
+		rev->sp[k] += p[k];
+		rev->sp2[k] += p[k] * p[k];
+		rev->sdtp[k] += dt * p[k];
+	}
+
+	rev->node_n[node]++;
+	rev->node_dt[node] += (float)dt;
+	rev->node_p[node] += (float)p[CAL_RAW];
+}
+
+static void run_sample(uint16_t raw, uint32_t cycles)
+{
+	uint16_t pos = raw << CAL_FRAC_BITS;
+	int32_t step = (int32_t)pos - run.prev_pos;
+
+	if (atomic_get(&cal_state) == CAL_IDLE) {
+		return;
+	}
+
+	if (!run.have_prev) {
+		run.have_prev = true;
+	} else if (step > CAL_FULL_TURN / 2 || step < -CAL_FULL_TURN / 2) {
+		/* Zero crossing, a large jump backward is a forward wrap */
+		int8_t dir = step < 0 ? 1 : -1;
+		uint32_t span = dir > 0 ? pos + CAL_FULL_TURN - run.prev_pos
+					: run.prev_pos + CAL_FULL_TURN - pos;
+		uint32_t to_zero = dir > 0 ? CAL_FULL_TURN - run.prev_pos : run.prev_pos;
+		uint32_t cross = run.prev_cycles +
+				 (uint32_t)(((uint64_t)(cycles - run.prev_cycles) * to_zero) / span);
+
+		if (run.in_rev && dir == run.dir) {
+			revolution_end(cross);
+			if (atomic_get(&cal_state) == CAL_IDLE) {
+				return;
+			}
+		}
+		revolution_begin(cross, dir);
+	} else if (run.in_rev && step * run.dir < -CAL_REVERSAL) {
+		run.rev.broken = true;
+	}
+
+	if (run.in_rev) {
+		revolution_add(pos, cycles);
+	}
+
+	run.prev_pos = pos;
+	run.prev_cycles = cycles;
+}
+
+void calibration_sample(uint16_t raw, uint32_t cycles)
+{
+	k_mutex_lock(&cal_lock, K_FOREVER);
+	run_sample(raw, cycles);
+	k_mutex_unlock(&cal_lock);
+}
+
+int calibration_start(enum scroll_axis_id axis, bool learn)
+{
+	if (axis >= AXIS_COUNT) {
+		return -EINVAL;
+	}
+
+	k_mutex_lock(&cal_lock, K_FOREVER);
+
+	if (atomic_get(&cal_state) != CAL_IDLE) {
+		k_mutex_unlock(&cal_lock);
+		return -EBUSY;
+	}
+
+	if (!learn && !cal_tables[axis].valid) {
+		k_mutex_unlock(&cal_lock);
+		return -ENOENT;
+	}
+
+	/* The sensor thread is not inside a sample while the run is reset */
+	memset(&run, 0, sizeof(run));
+	memset(&cal_result, 0, sizeof(cal_result));
+	cal_axis = axis;
+	atomic_set(&cal_state, learn ? CAL_LEARNING : CAL_VERIFYING);
+
+	k_mutex_unlock(&cal_lock);
+
+	return 0;
+}
+
+void calibration_stop(void)
+{
+	k_mutex_lock(&cal_lock, K_FOREVER);
+	atomic_set(&cal_state, CAL_IDLE);
+	k_mutex_unlock(&cal_lock);
+}
+
+bool calibration_running(enum scroll_axis_id axis)
+{
+	bool running;
+
+	k_mutex_lock(&cal_lock, K_FOREVER);
+	running = atomic_get(&cal_state) != CAL_IDLE && cal_axis == axis;
+	k_mutex_unlock(&cal_lock);
+
+	return running;
+}
+
+void calibration_report_get(struct cal_report *report)
+{
+	k_mutex_lock(&cal_lock, K_FOREVER);
+	*report = cal_result;
+	report->state = atomic_get(&cal_state);
+	report->axis = cal_axis;
+	report->tables = 0;
+	for (size_t axis = 0; axis < AXIS_COUNT; axis++) {
+		if (cal_tables[axis].valid) {
+			report->tables |= BIT(axis);
+		}
+	}
+	k_mutex_unlock(&cal_lock);
+}
+
+/* Learning runs are started from the shell only */
+static enum scroll_axis_id cal_axis_arg(size_t argc, char **argv)
+{
+	if (argc < 2) {
+		return AXIS_WHEEL;
+	}
+
+	for (size_t axis = 0; axis < AXIS_COUNT; axis++) {
+		if (strcmp(argv[1], cal_axis_names[axis]) == 0) {
+			return axis;
+		}
+	}
+
+	return AXIS_COUNT;
+}
+
+static int cmd_cal_run(const struct shell *sh, size_t argc, char **argv, bool learn)
+{
+	int err = calibration_start(cal_axis_arg(argc, argv), learn);
+
+	if (err) {
+		shell_error(sh, "Cannot start (err %d)", err);
+		return err;
+	}
+
+	shell_print(sh, "Spin the wheel steadily, one turn per second or slower, for %u turns",
+		    CAL_REVOLUTIONS);
+
+	return 0;
+}
+
+static int cmd_cal_learn(const struct shell *sh, size_t argc, char **argv)
+{
+	return cmd_cal_run(sh, argc, argv, true);
+}
+
+static int cmd_cal_verify(const struct shell *sh, size_t argc, char **argv)
+{
+	return cmd_cal_run(sh, argc, argv, false);
+}
+
+static int cmd_cal_stop(const struct shell *sh, size_t argc, char **argv)
+{
+	calibration_stop();
+
+	return 0;
+}
+
+static int cmd_cal_clear(const struct shell *sh, size_t argc, char **argv)
+{
+	int err = calibration_clear(cal_axis_arg(argc, argv));
+
+	if (err) {
+		shell_error(sh, "Cannot clear (err %d)", err);
+	}
+
+	return err;
+}
+
+static int cmd_cal_status(const struct shell *sh, size_t argc, char **argv)
+{
+	static const char *const states[] = {"idle", "learning", "verifying"};
+	struct cal_report report;
+
+	calibration_report_get(&report);
+
+	shell_print(sh, "state:            %s (%s)", states[report.state], cal_axis_names[report.axis]);
+	shell_print(sh, "tables:           wheel %s, pan %s",
+		    (report.tables & BIT(AXIS_WHEEL)) ? "yes" : "no",
+		    (report.tables & BIT(AXIS_PAN)) ? "yes" : "no");
+	shell_print(sh, "revolutions:      %u (%u rejected)", report.revolutions, report.rejected);
+	shell_print(sh, "uncorrected rms:  %u mLSB", report.raw_rms_mlsb);
+	shell_print(sh, "corrected rms:    %u mLSB", report.corrected_rms_mlsb);
+
+	return 0;
+}
+
+SHELL_STATIC_SUBCMD_SET_CREATE(cal_cmds,
+	SHELL_CMD_ARG(learn, NULL, "Learn a new table [wheel|pan]", cmd_cal_learn, 1, 1),
+	SHELL_CMD_ARG(verify, NULL, "Measure the stored table [wheel|pan]", cmd_cal_verify, 1, 1),
+	SHELL_CMD(stop, NULL, "Abort the running calibration", cmd_cal_stop),
+	SHELL_CMD_ARG(clear, NULL, "Forget a table [wheel|pan]", cmd_cal_clear, 1, 1),
+	SHELL_CMD(status, NULL, "Progress and speed deviation of the last run", cmd_cal_status),
+	SHELL_SUBCMD_SET_END
+);
+
+SHELL_CMD_REGISTER(cal, &cal_cmds, "Magnet nonlinearity calibration", NULL);
+#endif /* CONFIG_SCROLL_CALIBRATION_LEARN */
@@ -0,0 +1,173 @@
+#include <zephyr/kernel.h>
+#include <zephyr/devicetree.h>
+#include <zephyr/drivers/gpio.h>
+#include <zephyr/bluetooth/bluetooth.h>
+#include <zephyr/bluetooth/conn.h>
+#include <zephyr/logging/log.h>
+#include <soc.h>
+
+#include "charger.h"
+#include "magnetometer.h"
+
+LOG_MODULE_REGISTER(charger, CONFIG_SCROLL_LOG_LEVEL);
+
+/* Matches the battery read in main(), a change is seen by the next read */
+#define CHARGER_POLL_MS 1000
+
+/* 7.5-15 ms without latency while nothing has to be saved */
+#define CHARGER_CONN_PARAM BT_LE_CONN_PARAM(6, 12, 0, 400)
+
+static const char *const state_names[] = {
+	[CHARGER_BATTERY] = "battery",
+	[CHARGER_CHARGING] = "charging",
+	[CHARGER_EXTERNAL] = "external power",
+};
+
+/* BQ25101 ~CHG: low while a charge cycle is running */
+static const struct gpio_dt_spec charge_status =
+	GPIO_DT_SPEC_GET(DT_NODELABEL(charger_status), gpios);
+#if CONFIG_SCROLL_CHARGER_FAST
+/* Active selects the 100 mA charge current instead of 50 mA */
+static const struct gpio_dt_spec fast_charge =
+	GPIO_DT_SPEC_GET(DT_NODELABEL(charger_fast), gpios);
+#endif
+
+/* Parameters each host chose before they were shortened for external power */
+static struct bt_le_conn_param saved_params[CONFIG_BT_MAX_CONN];
+static bool params_saved[CONFIG_BT_MAX_CONN];
+
+static atomic_t state = ATOMIC_INIT(CHARGER_BATTERY);
+static enum charger_state pending;
+static struct k_work_delayable charger_work;
+
+static bool vbus_present(void)
+{
+	return (NRF_POWER->USBREGSTATUS & POWER_USBREGSTATUS_VBUSDETECT_Msk) != 0;
+}
+
+static enum charger_state charger_read(void)
+{
+	if (!vbus_present()) {
+		return CHARGER_BATTERY;
+	}
+
+	return gpio_pin_get_dt(&charge_status) > 0 ? CHARGER_CHARGING : CHARGER_EXTERNAL;
+}
+
+static void link_shorten(struct bt_conn *conn, void *data)
+{
+	uint8_t index = bt_conn_index(conn);
+	struct bt_conn_info info;
+	int err;
+
+	if (params_saved[index] || bt_conn_get_info(conn, &info) ||
+	    info.state != BT_CONN_STATE_CONNECTED) {
+		return;
+	}
+
+	saved_params[index].interval_min = info.le.interval;
+	saved_params[index].interval_max = info.le.interval;
+	saved_params[index].latency = info.le.latency;
+	saved_params[index].timeout = info.le.timeout;
+	params_saved[index] = true;
+
+	err = bt_conn_le_param_update(conn, CHARGER_CONN_PARAM);
+	if (err) {
+		LOG_WRN("Connection parameter update failed (err %d)", err);
+	}
+}
+
+static void link_restore(struct bt_conn *conn, void *data)
+{
+	uint8_t index = bt_conn_index(conn);
+
+	if (!params_saved[index]) {
+		return;
+	}
+
+	/* Fails harmlessly if the link is going away */
+	bt_conn_le_param_update(conn, &saved_params[index]);
+	params_saved[index] = false;
+}
+
+static void power_source_changed(bool external)
+{
+	magnetometer_external_power(external);
+
+#if CONFIG_SCROLL_CHARGER_FAST
+	gpio_pin_set_dt(&fast_charge, external);
+#endif
+
+	bt_conn_foreach(BT_CONN_TYPE_LE, external ? link_shorten : link_restore, NULL);
+}
+
+static void charger_poll(struct k_work *work)
+{
+	enum charger_state now = charger_read();
+	enum charger_state prev = atomic_get(&state);
+
+	/*
+	 * Taken only when two reads agree: without a cell the status pin
+	 * toggles as the charger starts and terminates over and over.
+	 */
+	if (now != prev && now == pending) {
+		atomic_set(&state, now);
+		LOG_INF("Power: %s", state_names[now]);
+
+		if ((prev == CHARGER_BATTERY) != (now == CHARGER_BATTERY)) {
+			power_source_changed(now != CHARGER_BATTERY);
+		}
+	}
+	pending = now;
+
+	k_work_reschedule(&charger_work, K_MSEC(CHARGER_POLL_MS));
+}
+
+static void connected(struct bt_conn *conn, uint8_t err)
+{
+	if (!err && atomic_get(&state) != CHARGER_BATTERY) {
+		link_shorten(conn, NULL);
+	}
+}
+
+static void disconnected(struct bt_conn *conn, uint8_t reason)
+{
+	params_saved[bt_conn_index(conn)] = false;
+}
+
+BT_CONN_CB_DEFINE(charger_conn_callbacks) = {
+	.connected = connected,
+	.disconnected = disconnected,
+};
+
+enum charger_state charger_state_get(void)
+{
+	return atomic_get(&state);
+}
+
+int charger_init(void)
+{
+	int err;
+
+	if (!gpio_is_ready_dt(&charge_status)) {
+		return -ENODEV;
+	}
+
+	err = gpio_pin_configure_dt(&charge_status, GPIO_INPUT);
+	if (err) {
+		return err;
+	}
+
+#if CONFIG_SCROLL_CHARGER_FAST
+	err = gpio_pin_configure_dt(&fast_charge, GPIO_OUTPUT_INACTIVE);
+	if (err) {
+		return err;
+	}
+#endif
+
+	pending = charger_read();
+	k_work_init_delayable(&charger_work, charger_poll);
+	k_work_schedule(&charger_work, K_NO_WAIT);
+
+	return 0;
+}
@@ -0,0 +1,232 @@
+#include <zephyr/kernel.h>
+#include <zephyr/init.h>
+#include <zephyr/bluetooth/bluetooth.h>
+#include <zephyr/bluetooth/conn.h>
+#include <zephyr/mgmt/mcumgr/mgmt/callbacks.h>
+#include <zephyr/mgmt/mcumgr/grp/img_mgmt/img_mgmt.h>
+#include <zephyr/logging/log.h>
+
+#include "dfu.h"
+#include "settings_cache.h"
+
+LOG_MODULE_REGISTER(scroll_dfu, CONFIG_SCROLL_DFU_LOG_LEVEL);
+
+/* 7.5-15 ms without latency: keeps the link busy for the whole transfer */
+#define DFU_CONN_PARAM BT_LE_CONN_PARAM(6, 12, 0, 400)
+
+/* Progress is logged every this many percent */
+#define DFU_PROGRESS_STEP 10
+
+struct dfu_link {
+	struct bt_conn *conn;
+	/* What the link ran with before the upload */
+	struct bt_le_conn_param saved;
+	struct bt_conn_le_phy_param saved_phy;
+	struct bt_conn_le_data_len_param saved_data_len;
+};
+
+static struct dfu_link dfu_links[CONFIG_BT_MAX_CONN];
+static struct dfu_stats dfu_stats;
+static int64_t upload_started_at;
+static bool upload_active;
+static uint8_t progress_logged;
+
+/*
+ * The SMP callbacks do not say which link carries the upload, so every
+ * connected link is sped up. The HID host pays for the short interval only
+ * while the transfer runs.
+ */
+static void link_speed_up(struct bt_conn *conn, void *user_data)
+{
+	size_t *count = user_data;
+	struct bt_conn_info info;
+	struct dfu_link *link;
+	int err;
+
+	if (*count >= ARRAY_SIZE(dfu_links) || bt_conn_get_info(conn, &info) ||
+	    info.state != BT_CONN_STATE_CONNECTED) {
+		return;
+	}
+
+	link = &dfu_links[(*count)++];
+	link->conn = bt_conn_ref(conn);
+	link->saved.interval_min = info.le.interval;
+	link->saved.interval_max = info.le.interval;
+	link->saved.latency = info.le.latency;
+	link->saved.timeout = info.le.timeout;
+	link->saved_phy = (struct bt_conn_le_phy_param)
+		BT_CONN_LE_PHY_PARAM_INIT(info.le.phy->tx_phy, info.le.phy->rx_phy);
+	link->saved_data_len = (struct bt_conn_le_data_len_param)
+		BT_LE_DATA_LEN_PARAM_INIT(info.le.data_len->tx_max_len,
+					  info.le.data_len->tx_max_time);
+
+	err = bt_conn_le_data_len_update(conn, BT_LE_DATA_LEN_PARAM_MAX);
+	if (err) {
+		LOG_WRN("Data length update failed (err %d)", err);
+	}
+
+	err = bt_conn_le_phy_update(conn, BT_CONN_LE_PHY_PARAM_2M);
+	if (err) {
+		LOG_WRN("PHY update failed (err %d)", err);
+	}
+
+	err = bt_conn_le_param_update(conn, DFU_CONN_PARAM);
+	if (err) {
+		LOG_WRN("Connection parameter update failed (err %d)", err);
+	}
+}
+
+/*
+ * Back to the PHY, data length, interval and latency the link had, a host
+ * that kept 1M PHY or short packets may have had its reasons.
+ */
+static void links_restore(void)
+{
+	for (size_t i = 0; i < ARRAY_SIZE(dfu_links); i++) {
+		struct dfu_link *link = &dfu_links[i];
+
+		if (link->conn == NULL) {
+			continue;
+		}
+
+		/* Fails harmlessly if the link is gone by now */
+		bt_conn_le_param_update(link->conn, &link->saved);
+		bt_conn_le_phy_update(link->conn, &link->saved_phy);
+		bt_conn_le_data_len_update(link->conn, &link->saved_data_len);
+		bt_conn_unref(link->conn);
+		link->conn = NULL;
+	}
+}
+
+static void upload_start(void)
+{
+	size_t count = 0;
+
+	upload_started_at = k_uptime_get();
+	upload_active = true;
+	progress_logged = 0;
+
+	dfu_stats.uploads++;
+	dfu_stats.bytes = 0;
+	dfu_stats.transfer_ms = 0;
+	dfu_stats.throughput_bps = 0;
+	dfu_stats.total_ms = 0;
+
+	bt_conn_foreach(BT_CONN_TYPE_LE, link_speed_up, &count);
+	LOG_INF("Upload started, %u links sped up", count);
+}
+
+static void upload_progress(uint32_t received, uint32_t image_size)
+{
+	uint32_t elapsed = (uint32_t)(k_uptime_get() - upload_started_at);
+	uint8_t percent;
+
+	dfu_stats.image_size = image_size;
+	dfu_stats.bytes = received;
+	dfu_stats.transfer_ms = elapsed;
+	dfu_stats.throughput_bps = elapsed ? (uint32_t)(((uint64_t)received * MSEC_PER_SEC) / elapsed) : 0;
+
+	if (image_size == 0) {
+		return;
+	}
+
+	percent = (uint8_t)(((uint64_t)received * 100U) / image_size);
+	if (percent >= progress_logged + DFU_PROGRESS_STEP) {
+		progress_logged = percent - (percent % DFU_PROGRESS_STEP);
+		LOG_INF("Upload %u%%, %u B/s", percent, dfu_stats.throughput_bps);
+	}
+}
+
+static void upload_end(bool complete)
+{
+	if (!upload_active) {
+		return;
+	}
+	upload_active = false;
+
+	links_restore();
+
+	if (complete) {
+		LOG_INF("Upload of %u bytes done in %u ms, %u B/s", dfu_stats.bytes,
+			dfu_stats.transfer_ms, dfu_stats.throughput_bps);
+	} else {
+		dfu_stats.aborted++;
+		LOG_WRN("Upload stopped after %u bytes", dfu_stats.bytes);
+	}
+}
+
+static enum mgmt_cb_return dfu_event(uint32_t event, enum mgmt_cb_return prev_status,
+				     int32_t *rc, uint16_t *group, bool *abort_more,
+				     void *data, size_t data_size)
+{
+	switch (event) {
+	case MGMT_EVT_OP_IMG_MGMT_DFU_STARTED:
+		upload_start();
+		break;
+
+	case MGMT_EVT_OP_IMG_MGMT_DFU_CHUNK: {
+		const struct img_mgmt_upload_check *check = data;
+
+		upload_progress(check->req->off + check->req->img_data.len, check->action->size);
+		break;
+	}
+
+	case MGMT_EVT_OP_IMG_MGMT_DFU_PENDING:
+		upload_end(true);
+		break;
+
+	case MGMT_EVT_OP_IMG_MGMT_DFU_STOPPED:
+		upload_end(false);
+		break;
+
+	case MGMT_EVT_OP_IMG_MGMT_DFU_CONFIRMED:
+		/* The swap itself runs in MCUboot after the reset and is not included */
+		dfu_stats.total_ms = (uint32_t)(k_uptime_get() - upload_started_at);
+		LOG_INF("Update confirmed %u ms after the upload started", dfu_stats.total_ms);
+		break;
+
+	default:
+		break;
+	}
+
+	return MGMT_CB_OK;
+}
+
+static struct mgmt_callback dfu_callback = {
+	.callback = dfu_event,
+	.event_id = MGMT_EVT_OP_IMG_MGMT_ALL,
+};
+
+#if CONFIG_MCUMGR_GRP_OS_RESET_HOOK
+/* The reset that applies an update would otherwise drop records still held in RAM */
+static enum mgmt_cb_return reset_event(uint32_t event, enum mgmt_cb_return prev_status,
+				       int32_t *rc, uint16_t *group, bool *abort_more,
+				       void *data, size_t data_size)
+{
+	settings_cache_flush();
+
+	return MGMT_CB_OK;
+}
+
+static struct mgmt_callback reset_callback = {
+	.callback = reset_event,
+	.event_id = MGMT_EVT_OP_OS_MGMT_RESET,
+};
+#endif
+
+void dfu_stats_get(struct dfu_stats *stats)
+{
+	*stats = dfu_stats;
+}
+
+static int dfu_init(void)
+{
+	mgmt_callback_register(&dfu_callback);
+#if CONFIG_MCUMGR_GRP_OS_RESET_HOOK
+	mgmt_callback_register(&reset_callback);
+#endif
+
+	return 0;
+}
+
+SYS_INIT(dfu_init, APPLICATION, CONFIG_APPLICATION_INIT_PRIORITY);
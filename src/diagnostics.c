@@ -0,0 +1,447 @@
+#include <zephyr/kernel.h>
+#include <zephyr/shell/shell.h>
+#include <zephyr/logging/log.h>
+#include <zephyr/init.h>
+#include <string.h>
+
+#include "diagnostics.h"
+#include "magnetometer.h"
+#include "pairing.h"
+#include "host_slots.h"
+#include "pacer.h"
+#if CONFIG_SCROLL_DFU
+#include "dfu.h"
+#endif
+#if CONFIG_SCROLL_ENERGY_PROFILE
+#include "energy.h"
+#endif
+#if CONFIG_SCROLL_SETTINGS_CACHE
+#include "settings_cache.h"
+#endif
+#if CONFIG_SCROLL_WAKE_SYNC
+#include "wake_sync.h"
+#endif
+
+LOG_MODULE_REGISTER(diagnostics, CONFIG_DIAGNOSTICS_LOG_LEVEL);
+
+#define DIAG_MAX_THREADS 16
+
+struct thread_sample {
+	const struct k_thread *thread;
+	uint64_t cycles;        /* execution cycles at the last collection */
+	uint16_t load;          /* permille of the last window */
+	size_t stack_size;
+	size_t stack_unused;
+};
+
+static struct thread_sample thread_samples[DIAG_MAX_THREADS];
+static size_t thread_sample_count;
+
+static uint64_t last_execution_cycles;
+static uint64_t last_idle_cycles;
+static uint64_t window_cycles;
+
+static struct diag_summary summary;
+
+static struct k_work_delayable diag_work;
+static struct k_work probe_work;
+static uint32_t probe_submit_cycles;
+static uint32_t probe_latency_max_us;
+
+static struct thread_sample *thread_sample_get(const struct k_thread *thread)
+{
+	for (size_t i = 0; i < thread_sample_count; i++) {
+		if (thread_samples[i].thread == thread) {
+			return &thread_samples[i];
+		}
+	}
+
+	if (thread_sample_count >= ARRAY_SIZE(thread_samples)) {
+		return NULL;
+	}
+
+	memset(&thread_samples[thread_sample_count], 0, sizeof(thread_samples[0]));
+	thread_samples[thread_sample_count].thread = thread;
+
+	return &thread_samples[thread_sample_count++];
+}
+
+static bool is_bt_thread(const struct k_thread *thread)
+{
+	const char *name = k_thread_name_get((k_tid_t)thread);
+
+	return name != NULL && strncmp(name, "BT", 2) == 0;
+}
+
+static void thread_collect(const struct k_thread *thread, void *user_data)
+{
+	struct thread_sample *sample = thread_sample_get(thread);
+	k_thread_runtime_stats_t stats;
+
+	ARG_UNUSED(user_data);
+
+	if (sample == NULL) {
+		return;
+	}
+
+	if (k_thread_runtime_stats_get((k_tid_t)thread, &stats) == 0) {
+		uint64_t delta = stats.execution_cycles - sample->cycles;
+
+		sample->load = window_cycles ? (uint16_t)((delta * 1000U) / window_cycles) : 0;
+		sample->cycles = stats.execution_cycles;
+	}
+
+	sample->stack_size = thread->stack_info.size;
+	if (k_thread_stack_space_get(thread, &sample->stack_unused) != 0) {
+		sample->stack_unused = 0;
+	}
+}
+
+static void summary_update(uint16_t cpu_load)
+{
+	struct diag_summary new_summary = {
+		.cpu_load = cpu_load,
+		.min_stack_free = UINT16_MAX,
+	};
+
+	for (size_t i = 0; i < thread_sample_count; i++) {
+		const struct thread_sample *sample = &thread_samples[i];
+		uint16_t unused = MIN(sample->stack_unused, UINT16_MAX);
+
+		if (sample->thread == sensor_data_collector_id) {
+			new_summary.sensor_load = sample->load;
+			new_summary.sensor_stack_free = unused;
+		} else if (sample->thread == &k_sys_work_q.thread) {
+			new_summary.sysworkq_stack_free = unused;
+		} else if (is_bt_thread(sample->thread)) {
+			new_summary.bt_load += sample->load;
+		} else {
+			const char *name = k_thread_name_get((k_tid_t)sample->thread);
+
+			if (name != NULL && strcmp(name, "main") == 0) {
+				new_summary.main_stack_free = unused;
+			}
+		}
+
+		new_summary.min_stack_free = MIN(new_summary.min_stack_free, unused);
+	}
+
+	new_summary.sysworkq_latency_us = MIN(probe_latency_max_us, UINT16_MAX);
+	probe_latency_max_us = 0;
+
+	summary = new_summary;
+}
+
+static void probe_handler(struct k_work *work)
+{
+	uint32_t latency_us = k_cyc_to_us_floor32(k_cycle_get_32() - probe_submit_cycles);
+
+	probe_latency_max_us = MAX(probe_latency_max_us, latency_us);
+}
+
+static void diag_collect(struct k_work *work)
+{
+	k_thread_runtime_stats_t all;
+	uint16_t cpu_load = summary.cpu_load;
+
+	if (k_thread_runtime_stats_all_get(&all) == 0) {
+		uint64_t idle = all.idle_cycles - last_idle_cycles;
+
+		window_cycles = all.execution_cycles - last_execution_cycles;
+		last_execution_cycles = all.execution_cycles;
+		last_idle_cycles = all.idle_cycles;
+
+		cpu_load = window_cycles ? (uint16_t)(1000U - (idle * 1000U) / window_cycles) : 0;
+	}
+
+	/* Stack scans are slow, do not hold the scheduler lock for them */
+	k_thread_foreach_unlocked(thread_collect, NULL);
+
+	summary_update(cpu_load);
+
+	LOG_DBG("CPU %u sensor %u BT %u permille, min stack free %u B, workq latency %u us",
+		summary.cpu_load, summary.sensor_load, summary.bt_load,
+		summary.min_stack_free, summary.sysworkq_latency_us);
+
+	/* The probe measures how long queued work waits behind whatever is ahead of it */
+	probe_submit_cycles = k_cycle_get_32();
+	k_work_submit(&probe_work);
+
+	k_work_schedule(&diag_work, K_MSEC(CONFIG_SCROLL_DIAGNOSTICS_PERIOD_MS));
+}
+
+void diagnostics_summary_get(struct diag_summary *out)
+{
+	*out = summary;
+}
+
+static int diagnostics_init(void)
+{
+	k_work_init(&probe_work, probe_handler);
+	k_work_init_delayable(&diag_work, diag_collect);
+	k_work_schedule(&diag_work, K_MSEC(CONFIG_SCROLL_DIAGNOSTICS_PERIOD_MS));
+
+	return 0;
+}
+
+SYS_INIT(diagnostics_init, APPLICATION, CONFIG_APPLICATION_INIT_PRIORITY);
+
+#if CONFIG_SHELL
+static int cmd_diag_threads(const struct shell *sh, size_t argc, char **argv)
+{
+	shell_print(sh, "%-20s %7s %12s", "thread", "load", "stack used");
+
+	for (size_t i = 0; i < thread_sample_count; i++) {
+		const struct thread_sample *sample = &thread_samples[i];
+		const char *name = k_thread_name_get((k_tid_t)sample->thread);
+
+		shell_print(sh, "%-20s %3u.%u %% %5u/%-5u",
+			    name ? name : "?",
+			    sample->load / 10, sample->load % 10,
+			    (unsigned int)(sample->stack_size - sample->stack_unused),
+			    (unsigned int)sample->stack_size);
+	}
+
+	return 0;
+}
+
+static int cmd_diag_summary(const struct shell *sh, size_t argc, char **argv)
+{
+	shell_print(sh, "cpu load:         %u.%u %%", summary.cpu_load / 10, summary.cpu_load % 10);
+	shell_print(sh, "sensor load:      %u.%u %%", summary.sensor_load / 10, summary.sensor_load % 10);
+	shell_print(sh, "bt load:          %u.%u %%", summary.bt_load / 10, summary.bt_load % 10);
+	shell_print(sh, "sensor stack:     %u B free", summary.sensor_stack_free);
+	shell_print(sh, "main stack:       %u B free", summary.main_stack_free);
+	shell_print(sh, "sysworkq stack:   %u B free", summary.sysworkq_stack_free);
+	shell_print(sh, "min stack:        %u B free", summary.min_stack_free);
+	shell_print(sh, "sysworkq latency: %u us", summary.sysworkq_latency_us);
+
+	return 0;
+}
+
+static int cmd_diag_adv(const struct shell *sh, size_t argc, char **argv)
+{
+	struct adv_stats stats;
+
+	advertising_stats_get(&stats);
+
+	shell_print(sh, "reconnect fast:   %u ms", stats.fast_ms[ADV_PROFILE_RECONNECT]);
+	shell_print(sh, "reconnect slow:   %u ms", stats.slow_ms[ADV_PROFILE_RECONNECT]);
+	shell_print(sh, "pairing fast:     %u ms", stats.fast_ms[ADV_PROFILE_PAIRING]);
+	shell_print(sh, "pairing slow:     %u ms", stats.slow_ms[ADV_PROFILE_PAIRING]);
+	shell_print(sh, "sessions:         %u", stats.sessions);
+	shell_print(sh, "timeouts:         %u", stats.timeouts);
+	shell_print(sh, "state:            %s", advertising_is_stopped() ? "stopped" :
+			is_adv_running ? "advertising" : "idle");
+
+	return 0;
+}
+
+static int cmd_diag_slots(const struct shell *sh, size_t argc, char **argv)
+{
+	struct host_slot_stats stats;
+
+	host_slot_stats_get(&stats);
+
+	shell_print(sh, "active slot:      %u", host_slot_active() + 1);
+	shell_print(sh, "switches:         %u", stats.switches);
+	shell_print(sh, "last switch:      %u ms", stats.last_switch_ms);
+	shell_print(sh, "slowest switch:   %u ms", stats.max_switch_ms);
+
+	return 0;
+}
+
+static int cmd_diag_sampling(const struct shell *sh, size_t argc, char **argv)
+{
+	struct sample_timing timing;
+
+	magnetometer_timing_get(&timing);
+
+	shell_print(sh, "samples:          %u", timing.samples);
+	shell_print(sh, "overruns:         %u", timing.overruns);
+	shell_print(sh, "jitter avg:       %u us", timing.jitter_avg_us);
+	shell_print(sh, "jitter max:       %u us", timing.jitter_max_us);
+	shell_print(sh, "queue peak:       %u of %u", timing.queue_peak, CONFIG_SCROLL_QUEUE_SIZE);
+	shell_print(sh, "queue drops:      %u", timing.queue_drops);
+
+	return 0;
+}
+
+static int cmd_diag_pacing(const struct shell *sh, size_t argc, char **argv)
+{
+	struct pacer_stats stats;
+
+	pacer_stats_get(&stats);
+
+	shell_print(sh, "interval:         %u us", stats.interval_us);
+	shell_print(sh, "paced reports:    %u", stats.reports);
+	shell_print(sh, "motion starts:    %u", stats.bursts);
+	shell_print(sh, "catch-ups:        %u", stats.catchups);
+	shell_print(sh, "reversals:        %u", stats.reversals);
+	shell_print(sh, "max backlog:      %u ticks", stats.max_backlog);
+
+	return 0;
+}
+
+#if CONFIG_SCROLL_DFU
+static int cmd_diag_dfu(const struct shell *sh, size_t argc, char **argv)
+{
+	struct dfu_stats stats;
+
+	dfu_stats_get(&stats);
+
+	shell_print(sh, "uploads:          %u (%u aborted)", stats.uploads, stats.aborted);
+	shell_print(sh, "received:         %u / %u bytes", stats.bytes, stats.image_size);
+	shell_print(sh, "transfer:         %u ms", stats.transfer_ms);
+	shell_print(sh, "throughput:       %u B/s", stats.throughput_bps);
+	shell_print(sh, "total update:     %u ms", stats.total_ms);
+
+	return 0;
+}
+#endif
+
+#if CONFIG_SCROLL_SETTINGS_CACHE
+static int cmd_diag_settings(const struct shell *sh, size_t argc, char **argv)
+{
+	struct settings_cache_stats stats;
+
+	settings_cache_stats_get(&stats);
+
+	shell_print(sh, "flash writes:     %u", stats.flash_writes);
+	shell_print(sh, "unchanged:        %u", stats.skipped);
+	shell_print(sh, "deferred:         %u", stats.deferred);
+	shell_print(sh, "idle flushes:     %u", stats.flushes);
+	shell_print(sh, "waiting:          %u", stats.dirty);
+	shell_print(sh, "uncached:         %u", stats.uncached);
+
+	return 0;
+}
+#endif
+
+#if CONFIG_SCROLL_WAKE_SYNC
+/* Count per second over the window, with two decimals */
+static void rate_print(const struct shell *sh, const char *label, uint32_t count,
+		       uint32_t elapsed_ms)
+{
+	uint32_t centi = elapsed_ms ? (uint32_t)(((uint64_t)count * 100U * MSEC_PER_SEC) / elapsed_ms) : 0;
+
+	shell_print(sh, "%-18s%u.%02u", label, centi / 100, centi % 100);
+}
+
+static int cmd_diag_wake(const struct shell *sh, size_t argc, char **argv)
+{
+	struct wake_sync_stats stats;
+	uint32_t wakes;
+
+	if (argc > 1 && strcmp(argv[1], "reset") == 0) {
+		wake_sync_stats_reset();
+		return 0;
+	}
+
+	wake_sync_stats_get(&stats);
+	/* An aligned sample rides on a radio wakeup instead of adding one */
+	wakes = stats.radio_events + stats.sensor_samples - stats.aligned_samples;
+
+	shell_print(sh, "window:           %u ms", stats.elapsed_ms);
+	shell_print(sh, "links:            %u (%u on the lead interval)", stats.links,
+		    stats.matched_links);
+	shell_print(sh, "lead interval:    %u us", stats.lead_interval_us);
+	shell_print(sh, "match requests:   %u", stats.match_requests);
+	rate_print(sh, "radio events/s:", stats.radio_events, stats.elapsed_ms);
+	rate_print(sh, "samples/s:", stats.sensor_samples, stats.elapsed_ms);
+	rate_print(sh, "aligned/s:", stats.aligned_samples, stats.elapsed_ms);
+	if (IS_ENABLED(CONFIG_BT_RADIO_NOTIFICATION_CONN_CB)) {
+		rate_print(sh, "wakeups/s:", wakes, stats.elapsed_ms);
+	} else {
+		shell_print(sh, "wakeups/s:        radio events not reported in this build");
+	}
+
+	return 0;
+}
+#endif
+
+#if CONFIG_SCROLL_ENERGY_PROFILE
+static void energy_print(const struct shell *sh, const char *name,
+			 const struct energy_sample *sample)
+{
+	shell_print(sh, "%-12s %7u ms  radio %8u us  CPU %8u us  sensor %7u ms  %6u wakeups  %7u nAh/h",
+		    name, sample->window_ms, sample->radio_on_us, sample->cpu_active_us,
+		    sample->sensor_on_ms, sample->wakeups, sample->avg_na);
+}
+
+static int cmd_diag_energy(const struct shell *sh, size_t argc, char **argv)
+{
+	static const char *const names[ENERGY_SCENARIO_COUNT] = {
+		"advertising", "idle", "occasional", "spinning",
+	};
+	struct energy_sample sample;
+
+	energy_window_get(&sample);
+	energy_print(sh, "window", &sample);
+
+	for (size_t i = 0; i < ENERGY_SCENARIO_COUNT; i++) {
+		energy_scenario_get(i, &sample);
+		if (sample.window_ms != 0) {
+			energy_print(sh, names[i], &sample);
+		}
+	}
+
+	/* "diag energy reset" starts a new window */
+	if (argc > 1 && strcmp(argv[1], "reset") == 0) {
+		energy_window_start();
+	}
+
+	return 0;
+}
+#endif
+
+static int cmd_diag_hid(const struct shell *sh, size_t argc, char **argv)
+{
+	static const uint32_t bounds_us[] = HID_SEND_BUCKET_BOUNDS_US;
+	struct hid_send_stats stats;
+
+	hid_send_stats_get(&stats);
+
+	shell_print(sh, "reports:          %u (%u batched, %u failed)",
+		    stats.calls, stats.batched, stats.errors);
+	shell_print(sh, "send avg:         %u us", stats.calls ? stats.total_us / stats.calls : 0);
+	shell_print(sh, "send max:         %u us", stats.max_us);
+	for (size_t i = 0; i < ARRAY_SIZE(bounds_us); i++) {
+		shell_print(sh, "  < %4u us:      %u", bounds_us[i], stats.buckets[i]);
+	}
+	shell_print(sh, "  >= %4u us:     %u", bounds_us[ARRAY_SIZE(bounds_us) - 1],
+		    stats.buckets[HID_SEND_BUCKETS - 1]);
+
+	/* "diag hid reset" starts a new measurement */
+	if (argc > 1 && strcmp(argv[1], "reset") == 0) {
+		hid_send_stats_reset();
+	}
+
+	return 0;
+}
+
+SHELL_STATIC_SUBCMD_SET_CREATE(diag_cmds,
+	SHELL_CMD(threads, NULL, "Per-thread CPU load and stack usage", cmd_diag_threads),
+	SHELL_CMD(summary, NULL, "CPU load, stack headroom and workqueue latency", cmd_diag_summary),
+	SHELL_CMD(adv, NULL, "Advertising time per profile and phase", cmd_diag_adv),
+	SHELL_CMD(slots, NULL, "Active host slot and switch times", cmd_diag_slots),
+	SHELL_CMD(sampling, NULL, "Sensor sampling jitter and scroll queue use", cmd_diag_sampling),
+	SHELL_CMD(pacing, NULL, "Scroll report pacing", cmd_diag_pacing),
+	SHELL_CMD_ARG(hid, NULL, "Time spent sending input reports [reset]", cmd_diag_hid, 1, 1),
+#if CONFIG_SCROLL_DFU
+	SHELL_CMD(dfu, NULL, "Last firmware upload time and throughput", cmd_diag_dfu),
+#endif
+#if CONFIG_SCROLL_SETTINGS_CACHE
+	SHELL_CMD(settings, NULL, "Settings writes saved by the record cache", cmd_diag_settings),
+#endif
+#if CONFIG_SCROLL_WAKE_SYNC
+	SHELL_CMD_ARG(wake, NULL, "Radio and sensor wakeups per second [reset]", cmd_diag_wake, 1, 1),
+#endif
+#if CONFIG_SCROLL_ENERGY_PROFILE
+	SHELL_CMD_ARG(energy, NULL, "Activity and current estimate [reset]", cmd_diag_energy, 1, 1),
+#endif
+	SHELL_SUBCMD_SET_END
+);
+
+SHELL_CMD_REGISTER(diag, &diag_cmds, "Runtime diagnostics", NULL);
+#endif /* CONFIG_SHELL */
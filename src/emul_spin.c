@@ -0,0 +1,64 @@
+#include <zephyr/kernel.h>
+#include <zephyr/init.h>
+#include <zephyr/drivers/emul.h>
+#include <zephyr/logging/log.h>
+
+#include "custom_as5600_emul.h"
+#include "scroll.h"
+
+LOG_MODULE_REGISTER(emul_spin, CONFIG_SCROLL_LOG_LEVEL);
+
+#define SPIN_STEP_MS 10
+#define SPIN_PAUSE_MS 2000
+
+/*
+ * Turns the emulated wheel in bursts while a host is connected and logs how
+ * long the reports of each burst took to hand to the host stack.
+ */
+static const struct emul *wheel_emul = EMUL_DT_GET(DT_NODELABEL(wheel));
+static struct k_work_delayable spin_work;
+static uint32_t wheel_mdeg;
+static uint32_t spun_ms;
+
+static void spin_report(void)
+{
+	struct hid_send_stats stats;
+
+	hid_send_stats_get(&stats);
+	LOG_INF("HID send: %u reports (%u batched, %u failed), avg %u us, max %u us",
+		stats.calls, stats.batched, stats.errors,
+		stats.calls ? stats.total_us / stats.calls : 0, stats.max_us);
+	hid_send_stats_reset();
+}
+
+static void spin_handler(struct k_work *work)
+{
+	if (!bt_connected) {
+		spun_ms = 0;
+		k_work_schedule(&spin_work, K_MSEC(SPIN_PAUSE_MS));
+		return;
+	}
+
+	if (spun_ms >= CONFIG_SCROLL_EMUL_SPIN_BURST_MS) {
+		spin_report();
+		spun_ms = 0;
+		k_work_schedule(&spin_work, K_MSEC(SPIN_PAUSE_MS));
+		return;
+	}
+
+	wheel_mdeg = (wheel_mdeg + CONFIG_SCROLL_EMUL_SPIN_DEG_PER_S * SPIN_STEP_MS) % (360U * 1000U);
+	as5600_emul_set_raw_angle(wheel_emul, (uint16_t)((wheel_mdeg * 4096U) / (360U * 1000U)));
+	spun_ms += SPIN_STEP_MS;
+
+	k_work_schedule(&spin_work, K_MSEC(SPIN_STEP_MS));
+}
+
+static int emul_spin_init(void)
+{
+	k_work_init_delayable(&spin_work, spin_handler);
+	k_work_schedule(&spin_work, K_MSEC(SPIN_PAUSE_MS));
+
+	return 0;
+}
+
+SYS_INIT(emul_spin_init, APPLICATION, CONFIG_APPLICATION_INIT_PRIORITY);
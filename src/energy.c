@@ -0,0 +1,260 @@
+#include <zephyr/kernel.h>
+#include <zephyr/init.h>
+#include <zephyr/logging/log.h>
+#include <nrfx_timer.h>
+#include <helpers/nrfx_gppi.h>
+#include <hal/nrf_radio.h>
+
+#if CONFIG_SCROLL_ENERGY_SCENARIOS
+#include <zephyr/drivers/emul.h>
+#include "custom_as5600_emul.h"
+#endif
+
+#include "energy.h"
+#include "magnetometer.h"
+#include "scroll.h"
+
+LOG_MODULE_REGISTER(energy, CONFIG_SCROLL_ENERGY_LOG_LEVEL);
+
+/*
+ * Radio-on time is counted in hardware: RADIO READY starts a 1 MHz timer
+ * and DISABLED stops it, so the measurement itself does not wake the CPU.
+ * Works the same on the nrf52_bsim models.
+ */
+static const nrfx_timer_t radio_timer = NRFX_TIMER_INSTANCE(2);
+
+static atomic_t idle_entries;
+
+static struct {
+	int64_t started_at;
+	uint32_t radio_us;
+	uint64_t execution_cycles;
+	uint64_t idle_cycles;
+	uint32_t sensor_ms;
+	uint32_t wakeups;
+} window;
+
+#if CONFIG_TRACING_USER
+/* Every idle entry ends in one wakeup */
+void sys_trace_idle_user(void)
+{
+	atomic_inc(&idle_entries);
+}
+#endif
+
+static void radio_timer_handler(nrf_timer_event_t event_type, void *context)
+{
+}
+
+static uint32_t radio_on_us(void)
+{
+	return nrfx_timer_capture(&radio_timer, NRF_TIMER_CC_CHANNEL0);
+}
+
+static void cpu_cycles_get(uint64_t *execution, uint64_t *idle)
+{
+	k_thread_runtime_stats_t all;
+
+	if (k_thread_runtime_stats_all_get(&all) == 0) {
+		*execution = all.execution_cycles;
+		*idle = all.idle_cycles;
+	} else {
+		*execution = 0;
+		*idle = 0;
+	}
+}
+
+void energy_window_start(void)
+{
+	window.started_at = k_uptime_get();
+	window.radio_us = radio_on_us();
+	cpu_cycles_get(&window.execution_cycles, &window.idle_cycles);
+	window.sensor_ms = magnetometer_powered_ms();
+	window.wakeups = atomic_get(&idle_entries);
+}
+
+void energy_window_get(struct energy_sample *sample)
+{
+	uint64_t execution;
+	uint64_t idle;
+	uint64_t charge_nc;
+	uint64_t window_us;
+
+	cpu_cycles_get(&execution, &idle);
+
+	sample->window_ms = (uint32_t)(k_uptime_get() - window.started_at);
+	sample->radio_on_us = radio_on_us() - window.radio_us;
+	sample->cpu_active_us = (uint32_t)k_cyc_to_us_floor64((execution - window.execution_cycles) -
+							     (idle - window.idle_cycles));
+	sample->sensor_on_ms = magnetometer_powered_ms() - window.sensor_ms;
+	sample->wakeups = atomic_get(&idle_entries) - window.wakeups;
+
+	/* us x uA gives pC, sleep current is in nA over the whole window */
+	window_us = (uint64_t)sample->window_ms * USEC_PER_MSEC;
+	charge_nc = ((uint64_t)sample->radio_on_us * CONFIG_SCROLL_ENERGY_RADIO_UA +
+		     (uint64_t)sample->cpu_active_us * CONFIG_SCROLL_ENERGY_CPU_UA +
+		     (uint64_t)sample->sensor_on_ms * USEC_PER_MSEC * CONFIG_SCROLL_ENERGY_SENSOR_UA) / 1000U +
+		    (uint64_t)sample->wakeups * CONFIG_SCROLL_ENERGY_WAKEUP_NC +
+		    (window_us * CONFIG_SCROLL_ENERGY_SLEEP_NA) / USEC_PER_SEC;
+
+	sample->avg_na = window_us ? (uint32_t)((charge_nc * USEC_PER_SEC) / window_us) : 0;
+}
+
+#if CONFIG_SCROLL_ENERGY_SCENARIOS
+/* The scenarios move the emulated wheel, ticks while it is moving */
+#define ENERGY_DRIVE_MS 10
+#define ENERGY_FLICK_PERIOD_MS 5000
+#define ENERGY_FLICK_MS 200
+#define ENERGY_FLICK_DEG 60
+#define ENERGY_SPIN_DEG_PER_S 360
+
+static const char *const scenario_names[ENERGY_SCENARIO_COUNT] = {
+	[ENERGY_SCENARIO_ADVERTISING] = "advertising",
+	[ENERGY_SCENARIO_IDLE] = "idle connected",
+	[ENERGY_SCENARIO_OCCASIONAL] = "occasional scrolling",
+	[ENERGY_SCENARIO_SPINNING] = "continuous spinning",
+};
+
+static const struct emul *wheel_emul = EMUL_DT_GET(DT_NODELABEL(wheel));
+static struct energy_sample scenario_results[ENERGY_SCENARIO_COUNT];
+static enum energy_scenario scenario;
+static int64_t scenario_started_at;
+static uint32_t drive_ticks;
+static uint32_t wheel_mdeg;
+static struct k_work_delayable scenario_work;
+
+static void wheel_turn(uint32_t mdeg)
+{
+	wheel_mdeg = (wheel_mdeg + mdeg) % (360U * 1000U);
+	as5600_emul_set_raw_angle(wheel_emul, (uint16_t)((wheel_mdeg * 4096U) / (360U * 1000U)));
+}
+
+static void scenario_begin(enum energy_scenario next)
+{
+	scenario = next;
+	scenario_started_at = k_uptime_get();
+	drive_ticks = 0;
+	energy_window_start();
+}
+
+static void scenario_end(void)
+{
+	struct energy_sample *result = &scenario_results[scenario];
+
+	energy_window_get(result);
+	/* Do not bill the scenario for the emulator ticks that script it */
+	result->wakeups -= MIN(result->wakeups, drive_ticks);
+
+	LOG_INF("%s: %u ms, radio %u us, CPU %u us, sensor %u ms, %u wakeups, %u nAh/h",
+		scenario_names[scenario], result->window_ms, result->radio_on_us,
+		result->cpu_active_us, result->sensor_on_ms, result->wakeups, result->avg_na);
+}
+
+/* Next time the script has to act, relative to now */
+static k_timeout_t scenario_step(uint32_t elapsed_ms)
+{
+	uint32_t remaining = CONFIG_SCROLL_ENERGY_SCENARIO_S * MSEC_PER_SEC - elapsed_ms;
+	uint32_t in_period;
+
+	switch (scenario) {
+	case ENERGY_SCENARIO_OCCASIONAL:
+		in_period = elapsed_ms % ENERGY_FLICK_PERIOD_MS;
+		if (in_period < ENERGY_FLICK_MS) {
+			wheel_turn((ENERGY_FLICK_DEG * 1000U * ENERGY_DRIVE_MS) / ENERGY_FLICK_MS);
+			drive_ticks++;
+			return K_MSEC(ENERGY_DRIVE_MS);
+		}
+		return K_MSEC(MIN(remaining, ENERGY_FLICK_PERIOD_MS - in_period));
+
+	case ENERGY_SCENARIO_SPINNING:
+		wheel_turn((ENERGY_SPIN_DEG_PER_S * ENERGY_DRIVE_MS));
+		drive_ticks++;
+		return K_MSEC(ENERGY_DRIVE_MS);
+
+	default:
+		/* Nothing moves, only come back when the scenario is over */
+		return K_MSEC(remaining);
+	}
+}
+
+static void scenario_handler(struct k_work *work)
+{
+	uint32_t elapsed_ms = (uint32_t)(k_uptime_get() - scenario_started_at);
+
+	/* Advertising is measured from boot, everything else needs a host */
+	if (scenario == ENERGY_SCENARIO_ADVERTISING && bt_connected) {
+		LOG_WRN("Host connected during the advertising scenario");
+		elapsed_ms = CONFIG_SCROLL_ENERGY_SCENARIO_S * MSEC_PER_SEC;
+	} else if (scenario != ENERGY_SCENARIO_ADVERTISING && !bt_connected) {
+		scenario_begin(scenario);
+		k_work_schedule(&scenario_work, K_SECONDS(1));
+		return;
+	}
+
+	if (elapsed_ms >= CONFIG_SCROLL_ENERGY_SCENARIO_S * MSEC_PER_SEC) {
+		scenario_end();
+		if (scenario + 1 >= ENERGY_SCENARIO_COUNT) {
+			LOG_INF("All energy scenarios done");
+			return;
+		}
+		scenario_begin(scenario + 1);
+		elapsed_ms = 0;
+	}
+
+	k_work_schedule(&scenario_work, scenario_step(elapsed_ms));
+}
+
+void energy_scenario_get(enum energy_scenario id, struct energy_sample *sample)
+{
+	*sample = scenario_results[id];
+}
+#else
+void energy_scenario_get(enum energy_scenario id, struct energy_sample *sample)
+{
+	*sample = (struct energy_sample){ 0 };
+}
+#endif /* CONFIG_SCROLL_ENERGY_SCENARIOS */
+
+static int energy_init(void)
+{
+	nrfx_timer_config_t config = NRFX_TIMER_DEFAULT_CONFIG(NRFX_MHZ_TO_HZ(1));
+	uint8_t ch_start;
+	uint8_t ch_stop;
+
+	config.bit_width = NRF_TIMER_BIT_WIDTH_32;
+	if (nrfx_timer_init(&radio_timer, &config, radio_timer_handler) != NRFX_SUCCESS) {
+		LOG_ERR("Radio timer init failed");
+		return -EIO;
+	}
+
+	if (nrfx_gppi_channel_alloc(&ch_start) != NRFX_SUCCESS ||
+	    nrfx_gppi_channel_alloc(&ch_stop) != NRFX_SUCCESS) {
+		LOG_ERR("No (D)PPI channels for radio timing");
+		return -ENOMEM;
+	}
+
+	nrfx_gppi_channel_endpoints_setup(ch_start,
+		nrf_radio_event_address_get(NRF_RADIO, NRF_RADIO_EVENT_READY),
+		nrfx_timer_task_address_get(&radio_timer, NRF_TIMER_TASK_START));
+	nrfx_gppi_channel_endpoints_setup(ch_stop,
+		nrf_radio_event_address_get(NRF_RADIO, NRF_RADIO_EVENT_DISABLED),
+		nrfx_timer_task_address_get(&radio_timer, NRF_TIMER_TASK_STOP));
+	nrfx_gppi_channels_enable(BIT(ch_start) | BIT(ch_stop));
+
+	/* Enabling starts the count, the radio events drive it from here on */
+	nrfx_timer_enable(&radio_timer);
+	nrfx_timer_pause(&radio_timer);
+	nrfx_timer_clear(&radio_timer);
+
+	energy_window_start();
+
+#if CONFIG_SCROLL_ENERGY_SCENARIOS
+	k_work_init_delayable(&scenario_work, scenario_handler);
+	scenario_begin(ENERGY_SCENARIO_ADVERTISING);
+	k_work_schedule(&scenario_work, K_NO_WAIT);
+#endif
+
+	return 0;
+}
+
+SYS_INIT(energy_init, APPLICATION, CONFIG_APPLICATION_INIT_PRIORITY);
@@ -0,0 +1,169 @@
+#include <zephyr/kernel.h>
+#include <zephyr/settings/settings.h>
+#include <zephyr/bluetooth/bluetooth.h>
+#include <zephyr/bluetooth/conn.h>
+#include <zephyr/bluetooth/hci.h>
+#include <zephyr/logging/log.h>
+
+#include "host_slots.h"
+#include "pairing.h"
+#include "shelf.h"
+
+LOG_MODULE_REGISTER(host_slots, CONFIG_PAIRING_LOG_LEVEL);
+
+static uint8_t active_slot;
+static uint8_t slot_count = 1;
+static int64_t switch_started_at;
+static struct host_slot_stats slot_stats;
+
+#if CONFIG_SETTINGS
+static int slot_settings_set(const char *name, size_t len,
+			     settings_read_cb read_cb, void *cb_arg)
+{
+	int rc;
+
+	if (!settings_name_steq(name, "active", NULL)) {
+		return -ENOENT;
+	}
+
+	if (len != sizeof(active_slot)) {
+		return -EINVAL;
+	}
+
+	rc = read_cb(cb_arg, &active_slot, sizeof(active_slot));
+
+	return rc < 0 ? rc : 0;
+}
+
+SETTINGS_STATIC_HANDLER_DEFINE(host_slots, "slots", NULL, slot_settings_set, NULL, NULL);
+#endif
+
+int host_slots_init(void)
+{
+	bt_addr_le_t addrs[CONFIG_BT_ID_MAX];
+	size_t count = ARRAY_SIZE(addrs);
+
+	/* Identities are stored with the bonds, so this only creates them on first boot */
+	bt_id_get(addrs, &count);
+	while (count < HOST_SLOT_COUNT) {
+		int id = bt_id_create(NULL, NULL);
+
+		if (id < 0) {
+			LOG_ERR("Cannot create identity for slot %zu (err %d)", count, id);
+			break;
+		}
+		count++;
+	}
+
+	slot_count = count;
+	/* The slot in use when the device was shelved wins over a possibly lost settings write */
+	if (shelf_woke()) {
+		active_slot = shelf_retained_slot();
+	}
+	if (active_slot >= slot_count) {
+		active_slot = 0;
+	}
+	shelf_retain_slot(active_slot);
+
+	LOG_INF("Host slot %u of %u active", active_slot + 1, slot_count);
+
+	return 0;
+}
+
+uint8_t host_slot_active(void)
+{
+	return active_slot;
+}
+
+/* Returns true if a disconnection is on its way, advertising resumes from disconnected() */
+static bool disconnect_all(void)
+{
+	bool pending = false;
+
+	for (size_t i = 0; i < CONFIG_BT_HIDS_MAX_CLIENT_COUNT; i++) {
+		if (conn_mode[i].conn &&
+		    !bt_conn_disconnect(conn_mode[i].conn, BT_HCI_ERR_REMOTE_USER_TERM_CONN)) {
+			pending = true;
+		}
+	}
+
+	return pending;
+}
+
+void host_slot_select(uint8_t slot)
+{
+	if (slot >= slot_count) {
+		LOG_WRN("No host slot %u", slot + 1);
+		return;
+	}
+
+	if (slot == active_slot) {
+		/* Same host: only wake advertising up if it has timed out */
+		advertising_resume();
+		return;
+	}
+
+	LOG_INF("Switching to host slot %u", slot + 1);
+
+	active_slot = slot;
+	shelf_retain_slot(slot);
+	slot_stats.switches++;
+	switch_started_at = k_uptime_get();
+
+	if (IS_ENABLED(CONFIG_SETTINGS)) {
+		settings_save_one("slots/active", &active_slot, sizeof(active_slot));
+	}
+
+	advertising_request_directed();
+	if (!disconnect_all()) {
+		advertising_start();
+	}
+}
+
+void host_slot_clear(void)
+{
+	int err;
+
+	LOG_INF("Clearing host slot %u", active_slot + 1);
+
+	switch_started_at = 0;
+
+	/* Also disconnects the slot's host if it is connected */
+	err = bt_unpair(active_slot, BT_ADDR_LE_ANY);
+	if (err) {
+		LOG_ERR("Cannot clear host slot %u (err %d)", active_slot + 1, err);
+	}
+
+	if (!disconnect_all()) {
+		advertising_start();
+	}
+}
+
+void host_slot_connected(struct bt_conn *conn)
+{
+	struct bt_conn_info info;
+	uint32_t elapsed;
+
+	if (!switch_started_at) {
+		return;
+	}
+
+	if (bt_conn_get_info(conn, &info) || info.id != active_slot) {
+		return;
+	}
+
+	elapsed = (uint32_t)k_uptime_delta(&switch_started_at);
+	switch_started_at = 0;
+
+	slot_stats.last_switch_ms = elapsed;
+	if (elapsed > slot_stats.max_switch_ms) {
+		slot_stats.max_switch_ms = elapsed;
+	}
+
+	LOG_INF("Switched to host slot %u in %u ms", active_slot + 1, elapsed);
+}
+
+void host_slot_stats_get(struct host_slot_stats *stats)
+{
+	*stats = slot_stats;
+}
@@ -3,40 +3,49 @@
 #include <zephyr/device.h>
 #include <zephyr/devicetree.h>
 #include <zephyr/drivers/sensor.h>
-#include <zephyr/drivers/regulator.h>
-#include <math.h>
+#include <zephyr/pm/device_runtime.h>
+#include <zephyr/logging/log.h>
+#include <stdlib.h>
 
 #include "magnetometer.h"
 #include "scroll.h"
 #include "custom_as5600.h"
+#include "status_service.h"
+#include "boot_profile.h"
+#include "pairing.h"
+#include "calibration.h"
+#include "personality.h"
+
+LOG_MODULE_REGISTER(magnetometer, CONFIG_MAGNETOMETER_LOG_LEVEL);
 
 #define SENSOR_THREAD_PRIORITY 7
-#define SENSOR_THREAD_STACKSIZE 1024
+#define SENSOR_THREAD_STACKSIZE CONFIG_SCROLL_SENSOR_STACK_SIZE
 
-static const struct device *regulator_dev = DEVICE_DT_GET(DT_NODELABEL(mag_pwr));
 
 /* Initialize scroll resolution multiplier with default value */
 uint8_t scroll_resolution_multiplier = SCROLL_RESOLUTION_MULTIPLIER;
 bool hirez_enabled = false;
 
-static const struct device *get_as5600_sensor(void)
+/* Vertical wheel, and an optional second AS5600 for horizontal scrolling (AC Pan) */
+#define WHEEL_NODE DT_NODELABEL(wheel)
+#define PAN_WHEEL_NODE DT_NODELABEL(pan_wheel)
+
+static const struct device *get_as5600_sensor(const struct device *const dev)
  {
- 	const struct device *const dev = DEVICE_DT_GET_ONE(zephyr_custom_as5600);
- 	//const struct device *const dev = DT_COMPAT_ams_as5600_BUS_i2c;
- 
  	if (dev == NULL) {
  		/* No such node, or the node does not have status "okay". */
- 		printk("\nError: no device found.\n");
+ 		LOG_ERR("No AS5600 device found");
  		return NULL;
  	}
 
-	while (!device_is_ready(dev)) {
-		k_sleep(K_MSEC(10));	
-		printk("\nError: Device \"%s\" is not ready; "
- 		       "check the driver initialization logs for errors.\n",
- 		       dev->name);
-	} 
- 	printk("Found device \"%s\", getting sensor data\n", dev->name);
+	/* Drivers finish init in POST_KERNEL, long before the first connection */
+	if (!device_is_ready(dev)) {
+		LOG_ERR("Device \"%s\" is not ready; "
+			"check the driver initialization logs for errors.",
+			dev->name);
+		return NULL;
+	}
+ 	LOG_INF("Found device \"%s\", getting sensor data", dev->name);
  	return dev;
  }
 
@@ -80,115 +89,534 @@ static int64_t dt(int64_t time_start, int64_t time_end)
 enum power_mode {
 	ACTIVE_MODE,
 	LPM_MODE,
-	DOZE_MODE
+	DOZE_MODE,
+	POWERED_MODE	/* on external power, never steps down */
+};
+
+enum filter_profile {
+	FILTER_REST,
+	FILTER_SPIN
+};
+
+struct filter_settings {
+	enum as5600_slow_filter slow_filter;
+	enum as5600_fast_filter fast_filter;
+	enum as5600_watchdog watchdog;
+};
+
+static const struct filter_settings filter_profiles[] = {
+	/* 16x averaging for a stable angle; the watchdog drops the sensor into LPM3 after a minute without motion */
+	[FILTER_REST] = {AS5600_SLOW_FILTER_16x, AS5600_FAST_FILTER_SLOW_ONLY, AS5600_WATCHDOG_ON},
+	/* Large steps bypass the slow filter so its settling time does not lag behind the wheel */
+	[FILTER_SPIN] = {AS5600_SLOW_FILTER_4x, AS5600_FAST_FILTER_6LSB, AS5600_WATCHDOG_OFF},
 };
 
-static void set_sensor_defaults(const struct device *sensor_dev)
+/* Per-sensor scroll state; both axes share one sampling schedule */
+struct scroll_axis {
+	const struct device *dev;	/* NULL if the axis is not fitted */
+	int32_t prev_pos;		/* 1/16 counts, negative until the first sample */
+	int32_t accumulator;		/* fractional scroll ticks, SCROLL_COUNTS_PER_REV per tick */
+	int32_t motion;			/* rotation of the last sample for the dial, 1/16 counts */
+	int32_t dial_ref;		/* position the dial last reported from, 1/16 counts */
+	bool prev_neg;
+	uint8_t spin_settle;		/* samples left before returning to the rest filter */
+	enum filter_profile filter;
+	bool degraded;			/* magnet outside the recommended range */
+	bool powered;
+	bool configured;
+	int64_t powered_at;		/* uptime of the last power-up */
+};
+
+static struct scroll_axis axes[AXIS_COUNT] = {
+	[AXIS_WHEEL] = {
+		.dev = DEVICE_DT_GET(WHEEL_NODE),
+		.prev_pos = -1,
+	},
+#if DT_NODE_HAS_STATUS(PAN_WHEEL_NODE, okay)
+	[AXIS_PAN] = {
+		.dev = DEVICE_DT_GET(PAN_WHEEL_NODE),
+		.prev_pos = -1,
+	},
+#endif
+};
+
+static void apply_filter_profile(struct scroll_axis *axis, enum filter_profile profile)
+{
+	const struct filter_settings *settings = &filter_profiles[profile];
+
+	sensor_attr_set(axis->dev, SENSOR_CHAN_ROTATION, AS5600_SLOW_FILTER, &(struct sensor_value){.val1 = settings->slow_filter, .val2 = 0});
+	sensor_attr_set(axis->dev, SENSOR_CHAN_ROTATION, AS5600_FAST_FILTER, &(struct sensor_value){.val1 = settings->fast_filter, .val2 = 0});
+	sensor_attr_set(axis->dev, SENSOR_CHAN_ROTATION, AS5600_WATCHDOG, &(struct sensor_value){.val1 = settings->watchdog, .val2 = 0});
+	axis->filter = profile;
+}
+
+static struct magnet_health magnet_health;
+
+static void update_magnet_health(struct scroll_axis *axis)
+{
+	static uint32_t samples_since_poll = 0;
+	static int64_t last_warn_time = -MAGNET_WARN_INTERVAL_MS;
+	struct sensor_value val;
+	bool status_changed;
+
+	if (sensor_channel_get(axis->dev, AS5600_CHAN_MAGNET_STATUS, &val) != 0) {
+		return;
+	}
+
+	axis->degraded = (val.val1 != AS5600_MAGNET_OK);
+
+	/* The status service reports the main wheel's magnet */
+	if (axis != &axes[AXIS_WHEEL]) {
+		return;
+	}
+
+	status_changed = (val.val1 != magnet_health.status);
+	magnet_health.status = val.val1;
+
+	if (axis->degraded) {
+		magnet_health.degraded_samples++;
+
+		int64_t now = k_uptime_get();
+		if (dt(last_warn_time, now) >= MAGNET_WARN_INTERVAL_MS) {
+			LOG_WRN("Magnet %s, using angles in degraded mode (%u samples)",
+			       val.val1 == AS5600_MAGNET_TOO_WEAK ? "too weak" : "too strong",
+			       magnet_health.degraded_samples);
+			last_warn_time = now;
+		}
+	}
+
+	/* AGC and magnitude drift slowly, poll them at a fraction of the sample rate */
+	if (!status_changed && ++samples_since_poll < MAGNET_HEALTH_PERIOD_SAMPLES) {
+		return;
+	}
+	samples_since_poll = 0;
+
+	if (sensor_sample_fetch_chan(axis->dev, AS5600_CHAN_AGC) == 0) {
+		sensor_channel_get(axis->dev, AS5600_CHAN_AGC, &val);
+		magnet_health.agc = val.val1;
+		sensor_channel_get(axis->dev, AS5600_CHAN_MAGNITUDE, &val);
+		magnet_health.magnitude = val.val1;
+	}
+
+	status_service_magnet_update(&magnet_health);
+}
+
+/* Position seen by the last wake poll in 1/16 counts, negative until the first one */
+static int32_t wake_reference_pos = -1;
+
+/*
+ * Advertising has timed out and no host is connected: briefly power the
+ * sensor and report whether the wheel has been turned since the last poll.
+ */
+static bool wheel_moved(const struct device *sensor_dev)
+{
+	struct sensor_value raw;
+	int32_t pos;
+	int32_t delta;
+	int ret;
+
+	/* Resuming powers mag_pwr and waits for the sensor's power-up time */
+	ret = pm_device_runtime_get(sensor_dev);
+	if (ret < 0) {
+		return false;
+	}
+	ret = sensor_sample_fetch_chan(sensor_dev, SENSOR_CHAN_ROTATION);
+	if (ret == 0) {
+		ret = sensor_channel_get(sensor_dev, AS5600_CHAN_RAW_ANGLE, &raw);
+	}
+	pm_device_runtime_put(sensor_dev);
+
+	if (ret != 0) {
+		return false;
+	}
+
+	pos = raw.val1 << 4;
+	if (wake_reference_pos < 0) {
+		wake_reference_pos = pos;
+		return false;
+	}
+
+	delta = abs(pos - wake_reference_pos);
+	if (delta > SCROLL_COUNTS_PER_REV / 2) {
+		delta = SCROLL_COUNTS_PER_REV - delta;
+	}
+
+	return delta >= SCROLL_DEG_TO_COUNTS(ADV_WAKE_MOTION_DEG);
+}
+
+/*
+ * Samples are paced by a periodic timer: expiries follow the timer's own
+ * schedule, so I2C and processing time do not stretch the period the way
+ * a relative sleep does.
+ */
+K_TIMER_DEFINE(sample_timer, NULL, NULL);
+
+static struct sample_timing sample_timing;
+static uint32_t sample_period_us;
+static uint32_t last_sample_cycles;
+static bool sampling;
+static atomic_t external_power;
+/* Connection interval of the lead host, 0 if its events are not reported */
+static atomic_t sync_interval_us;
+/* Sample period while following the lead host's events, 0 while free-running */
+static atomic_t sync_period_us;
+/* Connection events since the last aligned sample, reset by both contexts */
+static atomic_t sync_events;
+
+static void sample_timer_start_us(uint32_t period_us)
+{
+	sample_period_us = period_us;
+	sampling = true;
+	last_sample_cycles = 0;
+	k_timer_start(&sample_timer, K_USEC(period_us), K_USEC(period_us));
+}
+
+static void sample_timer_start(uint32_t period_ms)
 {
-	sensor_attr_set(sensor_dev, SENSOR_CHAN_ROTATION, AS5600_POWER_MODE, &(struct sensor_value){.val1 = AS5600_POWER_MODE_LPM1, .val2 = 0}); // Set initial power mode to LPM1
-	sensor_attr_set(sensor_dev, SENSOR_CHAN_ROTATION, AS5600_HYSTERESIS, &(struct sensor_value){.val1 = AS5600_HYSTERESIS_2LSB, .val2 = 0}); // Set hysteresis to reduce jitter
+	atomic_set(&sync_period_us, 0);
+	sample_timer_start_us(period_ms * USEC_PER_MSEC);
+}
+
+static void sample_timer_stop(void)
+{
+	atomic_set(&sync_period_us, 0);
+	k_timer_stop(&sample_timer);
+	sampling = false;
+}
+
+/*
+ * In the active mode, sample once every whole number of the lead host's
+ * connection intervals, as close to the mode's own period as that allows.
+ * magnetometer_sync() then starts each sample right before a connection
+ * event, so the sensor read and the radio share one wakeup.
+ */
+static void sample_sync_update(void)
+{
+	uint32_t interval_us = atomic_get(&sync_interval_us);
+	uint32_t period_us;
+
+	if (interval_us == 0) {
+		if (atomic_get(&sync_period_us) != 0) {
+			sample_timer_start(ACTIVE_MODE_PERIOD_MS);
+		}
+		return;
+	}
+
+	period_us = MAX(ACTIVE_MODE_PERIOD_MS * USEC_PER_MSEC / interval_us, 1U) * interval_us;
+	if (period_us != atomic_get(&sync_period_us)) {
+		atomic_clear(&sync_events);
+		sample_timer_start_us(period_us);
+		atomic_set(&sync_period_us, period_us);
+	}
+}
+
+/* Book a sample taken at the given hardware counter value, returns the real time since the previous one in us */
+static uint32_t sample_timing_update(uint32_t now_cycles, uint32_t expiries)
+{
+	uint32_t period_us;
+	uint32_t nominal_us;
+	uint32_t deviation_us;
+
+	sample_timing.samples++;
+	if (expiries > 1) {
+		sample_timing.overruns += expiries - 1;
+	}
+
+	if (last_sample_cycles == 0) {
+		last_sample_cycles = now_cycles;
+		return sample_period_us;
+	}
+
+	period_us = k_cyc_to_us_floor32(now_cycles - last_sample_cycles);
+	last_sample_cycles = now_cycles;
+
+	nominal_us = MAX(expiries, 1U) * sample_period_us;
+	deviation_us = period_us > nominal_us ? period_us - nominal_us : nominal_us - period_us;
+
+	if (deviation_us > sample_timing.jitter_max_us) {
+		sample_timing.jitter_max_us = deviation_us;
+	}
+	/* Running average over roughly the last 16 samples */
+	sample_timing.jitter_avg_us += ((int32_t)deviation_us - (int32_t)sample_timing.jitter_avg_us) / 16;
+
+	return period_us;
+}
+
+void magnetometer_timing_get(struct sample_timing *timing)
+{
+	*timing = sample_timing;
+}
+
+/* Sensor supply-on time of finished power cycles, summed over the axes */
+static uint32_t sensors_powered_ms;
+
+uint32_t magnetometer_powered_ms(void)
+{
+	int64_t now = k_uptime_get();
+	uint32_t total = sensors_powered_ms;
+
+	for (size_t i = 0; i < AXIS_COUNT; i++) {
+		if (axes[i].powered) {
+			total += (uint32_t)(now - axes[i].powered_at);
+		}
+	}
+
+	return total;
+}
+
+static void set_sensor_defaults(struct scroll_axis *axis)
+{
+	sensor_attr_set(axis->dev, SENSOR_CHAN_ROTATION, AS5600_POWER_MODE, &(struct sensor_value){.val1 = AS5600_POWER_MODE_LPM1, .val2 = 0}); // Set initial power mode to LPM1
+	sensor_attr_set(axis->dev, SENSOR_CHAN_ROTATION, AS5600_HYSTERESIS, &(struct sensor_value){.val1 = AS5600_HYSTERESIS_2LSB, .val2 = 0}); // Set hysteresis to reduce jitter
+	apply_filter_profile(axis, FILTER_REST);
+}
+
+/*
+ * The sensor's runtime PM state owns its supply regulator. The driver
+ * restores CONF on resume, so the defaults are only written once.
+ */
+static void sensor_power(struct scroll_axis *axis, bool on)
+{
+	if (axis->dev == NULL || on == axis->powered) {
+		return;
+	}
+
+	if (on) {
+		if (pm_device_runtime_get(axis->dev) < 0) {
+			LOG_ERR("Magnetometer %s failed to resume", axis->dev->name);
+			return;
+		}
+		if (!axis->configured) {
+			set_sensor_defaults(axis);
+			axis->configured = true;
+		}
+		sensor_sample_fetch(axis->dev); // Discard first sample after power-up
+		axis->powered_at = k_uptime_get();
+	} else {
+		pm_device_runtime_put(axis->dev);
+		sensors_powered_ms += (uint32_t)(k_uptime_get() - axis->powered_at);
+	}
+
+	axis->powered = on;
+	LOG_DBG("Magnetometer %s power %s", axis->dev->name, on ? "enabled" : "disabled");
+}
+
+static void sensors_power(bool on)
+{
+	for (size_t i = 0; i < AXIS_COUNT; i++) {
+		sensor_power(&axes[i], on);
+	}
+}
+
+static void sensors_power_mode(enum as5600_power_mode mode)
+{
+	for (size_t i = 0; i < AXIS_COUNT; i++) {
+		if (axes[i].dev != NULL) {
+			sensor_attr_set(axes[i].dev, SENSOR_CHAN_ROTATION, AS5600_POWER_MODE, &(struct sensor_value){.val1 = mode, .val2 = 0});
+		}
+	}
+}
+
+/* Handle wraparound at the 0/360 degree boundary (one revolution) */
+static int32_t pos_wrap(int32_t delta)
+{
+	if (delta > SCROLL_COUNTS_PER_REV / 2) {
+		delta -= SCROLL_COUNTS_PER_REV;
+	} else if (delta < -SCROLL_COUNTS_PER_REV / 2) {
+		delta += SCROLL_COUNTS_PER_REV;
+	}
+
+	return delta;
+}
+
+/* Fetch one axis and turn its rotation into whole scroll ticks, 0 when there is nothing to send */
+static int8_t axis_sample(struct scroll_axis *axis, uint32_t sample_dt_us, uint32_t sample_cycles)
+{
+	enum scroll_axis_id id = axis - axes;
+	struct sensor_value raw;
+	int32_t current_pos;
+	int32_t pos_delta;
+	int32_t ticks_per_rev;
+	int8_t scroll_delta;
+
+	axis->motion = 0;
+
+	int ret = sensor_sample_fetch_chan(axis->dev, SENSOR_CHAN_ROTATION);
+	if (ret != 0) {
+		/* -EAGAIN: the driver is backing off after a bus fault */
+		if (ret != -EAGAIN) {
+			LOG_ERR("sensor_sample_fetch failed: %d", ret);
+		}
+		return 0;
+	}
+	update_magnet_health(axis);
+	ret = sensor_channel_get(axis->dev, AS5600_CHAN_RAW_ANGLE, &raw);
+	if (ret != 0) {
+		LOG_ERR("sensor_channel_get RAW_ANGLE failed: %d", ret);
+		return 0;
+	}
+
+	LOG_DBG("Raw angle: %d", raw.val1);
+
+	/* Per-unit nonlinearity correction on the raw counts */
+	current_pos = calibration_correct(id, raw.val1);
+	/* Calculate delta with wraparound handling (one revolution) */
+	if (axis->prev_pos < 0) {
+		axis->prev_pos = current_pos;
+		axis->dial_ref = current_pos;
+	}
+	pos_delta = pos_wrap(current_pos - axis->prev_pos);
+	/* A marginal magnet is noisier: drop jitter but keep the reference angle so slow motion still adds up */
+	if (axis->degraded && abs(pos_delta) < MAGNET_DEGRADED_DEADBAND) {
+		return 0;
+	}
+	/* Update previous position */
+	axis->prev_pos = current_pos;
+
+	/* Follow rotation speed with the sensor's internal filters, using the real sample interval */
+	if ((uint64_t)abs(pos_delta) * USEC_PER_SEC >=
+	    (uint64_t)SCROLL_DEG_TO_COUNTS(SPIN_FAST_DEG_PER_S) * sample_dt_us) {
+		axis->spin_settle = SPIN_SETTLE_SAMPLES;
+		if (axis->filter != FILTER_SPIN) {
+			apply_filter_profile(axis, FILTER_SPIN);
+		}
+	} else if (axis->spin_settle > 0 && --axis->spin_settle == 0) {
+		apply_filter_profile(axis, FILTER_REST);
+	}
+
+	/* The calibration spins are not meant to scroll the host */
+	if (calibration_running(id)) {
+		calibration_sample(raw.val1, sample_cycles);
+		axis->accumulator = 0;
+		axis->dial_ref = current_pos;
+		return 0;
+	}
+
+	/*
+	 * The dial gets the rotation itself, without ticks or hysteresis. The
+	 * reference is held until the wheel has moved past the sensor's noise,
+	 * so a wheel at rest sends nothing and the sensor can step down.
+	 */
+	if (id == AXIS_WHEEL && hid_personality_get() == HID_PERSONALITY_DIAL) {
+		int32_t dial_delta = pos_wrap(current_pos - axis->dial_ref);
+
+		if (abs(dial_delta) >= DIAL_DEADBAND) {
+			axis->motion = dial_delta;
+			axis->dial_ref = current_pos;
+		}
+		axis->accumulator = 0;
+		return 0;
+	}
+	axis->dial_ref = current_pos;
+
+	/* Scaled by the tick count so every whole tick is exactly SCROLL_COUNTS_PER_REV */
+	ticks_per_rev = hirez_enabled ? SCROLL_TICKS_PER_REV : SCROLL_TICKS_PER_REV_NORMAL;
+	axis->accumulator += pos_delta * ticks_per_rev;
+
+	/* Convert accumulated units to integer scroll steps */
+	scroll_delta = (int8_t)CLAMP(axis->accumulator / SCROLL_COUNTS_PER_REV, INT8_MIN, INT8_MAX);
+	/* Apply hysteresis to avoid small jittery scrolls */
+	int8_t hysteresis = axis->degraded ? MAGNET_DEGRADED_HYSTERESIS : SCROLL_HYSTERESIS_THRESHOLD;
+	if (scroll_delta > 0 && axis->prev_neg && scroll_delta < hysteresis) return 0;
+	if (scroll_delta < 0 && !axis->prev_neg && scroll_delta > -hysteresis) return 0;
+	axis->prev_neg = (scroll_delta < 0);
+
+	if (scroll_delta != 0) {
+		/* Subtract sent units from accumulator, keeping remainder */
+		axis->accumulator -= scroll_delta * SCROLL_COUNTS_PER_REV;
+
+		LOG_DBG("Scroll delta: %d", scroll_delta);
+
+		#if SCROLL_INVERSE
+		scroll_delta = -scroll_delta;
+		#endif
+	}
+
+	return scroll_delta;
 }
 
 int sensor_data_collector(void)
 {
-	struct sensor_value rotation;
-	static float prev_rotation_angle = 500;
-	static float scroll_accumulator = 0; /* Accumulator for fractional scroll units */
-	static bool prev_neg = false;
 	static int64_t last_time = 0;
 	static enum power_mode current_power_mode = ACTIVE_MODE;
-	const struct device *sensor_dev = get_as5600_sensor();
-	k_timeout_t sleep_timeout = K_MSEC(ACTIVE_MODE_PERIOD_MS);
+	uint32_t period_ms = ACTIVE_MODE_PERIOD_MS;
+	uint32_t expiries;
+	uint32_t sample_cycles;
+	uint32_t sample_dt_us;
+
+	for (size_t i = 0; i < AXIS_COUNT; i++) {
+		if (axes[i].dev != NULL) {
+			axes[i].dev = get_as5600_sensor(axes[i].dev);
+		}
+	}
 
-	if (sensor_dev == NULL) {
+	if (axes[AXIS_WHEEL].dev == NULL) {
 		return -1;
 	}
 
-	set_sensor_defaults(sensor_dev);
+	/* Suspended at this point, the loop below powers and configures them */
+	boot_profile_mark(BOOT_STAGE_SENSOR);
 
     while (1) {
-		k_sleep(sleep_timeout); // 15ms delay ~66Hz sampling
+		/* In DOZE the sensors are only powered for the sample itself */
+		if (current_power_mode == DOZE_MODE) {
+			sensors_power(false);
+		}
+
+		/* Returns at once while the timer is stopped */
+		expiries = k_timer_status_sync(&sample_timer);
 
 		if (bt_connected) {
-			if (regulator_is_enabled(regulator_dev) == false) {
-				regulator_enable(regulator_dev);
-				printk("Magnetometer power enabled\n");
-				k_sleep(K_MSEC(15)); // Wait for sensor to power up
-				set_sensor_defaults(sensor_dev); // Re-initialize sensor after power-up
-				sensor_sample_fetch(sensor_dev); // Discard first sample after power-up
+			if (!sampling) {
+				sample_timer_start(period_ms);
 			}
+			sensors_power(true);
 		} else {
-			if (regulator_is_enabled(regulator_dev) == true) {
-				regulator_disable(regulator_dev);
-				printk("Magnetometer power disabled\n");
+			sensors_power(false);
+			sample_timer_stop();
+			if (advertising_is_stopped()) {
+				if (wheel_moved(axes[AXIS_WHEEL].dev)) {
+					LOG_INF("Wheel moved, resuming advertising");
+					wake_reference_pos = -1;
+					advertising_resume();
+				}
+				k_sleep(K_MSEC(ADV_WAKE_POLL_MS));
+				continue;
 			}
+			wake_reference_pos = -1;
 			k_sleep(K_MSEC(300));
 			continue;
 		}
-		
-		
-		int ret = sensor_sample_fetch(sensor_dev);
-		if (ret != 0) {
-			printk("sensor_sample_fetch failed: %d\n", ret);
-			continue;	
+
+		/* The angle is latched by the read, timestamp it with the hardware counter */
+		sample_cycles = k_cycle_get_32();
+		sample_dt_us = sample_timing_update(sample_cycles, expiries);
+
+		struct scroll_event event = {
+			.wheel = axis_sample(&axes[AXIS_WHEEL], sample_dt_us, sample_cycles),
+		};
+		if (axes[AXIS_PAN].dev != NULL) {
+			event.pan = axis_sample(&axes[AXIS_PAN], sample_dt_us, sample_cycles);
 		}
-		ret = sensor_channel_get(sensor_dev, SENSOR_CHAN_ROTATION, &rotation);
-		if (ret != 0) {
-			printk("sensor_channel_get ROTATION failed: %d\n", ret);
-			continue;
+		event.dial = CLAMP(axes[AXIS_WHEEL].motion, INT16_MIN, INT16_MAX);
+		event.angle = axes[AXIS_WHEEL].prev_pos;
+
+		/* Calibration spins send nothing, keep the sensors in the active mode meanwhile */
+		if (calibration_running(AXIS_WHEEL) || calibration_running(AXIS_PAN)) {
+			last_time = k_uptime_get();
 		}
-		
-		printk("\rRotation: %d.%06d degrees", rotation.val1, rotation.val2);
-
-		float current_angle;
-		float angle_delta;
-		int8_t scroll_delta;
-		
-		/* Convert sensor_value rotation (degrees) to integer angle */
-		current_angle = rotation.val1 + (rotation.val2 / 1000000.0f);
-		//if (current_angle > 360.f) continue;
-		/* Calculate delta with wraparound handling (0-360 degrees) */
-		if (prev_rotation_angle > 360) prev_rotation_angle = current_angle;
-		angle_delta = current_angle - prev_rotation_angle;
-		
-		/* Handle wraparound at 0/360 degree boundary */
-		if (angle_delta > 180.f) {
-			angle_delta -= 360.f;
-		} else if (angle_delta < -180.f) {
-			angle_delta += 360.f;
-		}
-		// if (current_power_mode == DOZE_MODE) {
-		// 	printf("Current angle: %f, Previous angle: %f, Angle delta: %f\n", current_angle, prev_rotation_angle, angle_delta);
-		// }
-		/* Update previous angle */
-		prev_rotation_angle = current_angle;
-		
-		scroll_accumulator += angle_delta;
-		
-		/* Convert accumulated units to integer scroll steps */
-		if (hirez_enabled) {
-			scroll_delta = (int8_t)(scroll_accumulator / SCROLL_DEGREES_PER_TICK);
-		} else {
-			scroll_delta = (int8_t)(scroll_accumulator / SCROLL_DEGREES_PER_TICK_NORMAL);
-		}
-		/* Apply hysteresis to avoid small jittery scrolls */		
-		if (scroll_delta > 0 && prev_neg && scroll_delta < SCROLL_HYSTERESIS_THRESHOLD) continue;
-		if (scroll_delta < 0 && !prev_neg && scroll_delta > -SCROLL_HYSTERESIS_THRESHOLD) continue;
-		prev_neg = (scroll_delta < 0);
-
-		/* Send scroll events if we have full steps */
-		if (scroll_delta != 0) {
-			/* Subtract sent units from accumulator, keeping remainder */
-			scroll_accumulator -= (scroll_delta * SCROLL_DEGREES_PER_TICK);
-
-			//printk("Scroll delta: %d\n", scroll_delta);
-			
-			#if SCROLL_INVERSE
-			scroll_delta = -scroll_delta;
-			#endif
-			k_msgq_put(&scroll_queue, &scroll_delta, K_NO_WAIT);
-
-			if (k_msgq_num_used_get(&scroll_queue) == 1) {
+
+		/* Both axes travel in one report, so a diagonal flick costs one notification */
+		if (event.wheel != 0 || event.pan != 0 || event.dial != 0) {
+			uint32_t queued;
+
+			if (k_msgq_put(&scroll_queue, &event, K_NO_WAIT) != 0) {
+				sample_timing.queue_drops++;
+			}
+
+			queued = k_msgq_num_used_get(&scroll_queue);
+			sample_timing.queue_peak = MAX(sample_timing.queue_peak, queued);
+			if (queued == 1) {
 				k_work_submit(&hids_work);
 			}
 			last_time = k_uptime_get();
@@ -197,24 +625,75 @@ int sensor_data_collector(void)
 		/* Power mode management based on inactivity time */
 		int64_t current_time = k_uptime_get();
 		int64_t inactive_time = dt(last_time, current_time);
-		if (inactive_time >= DOZE_TIMEOUT_MS && current_power_mode != DOZE_MODE) {
+		if (atomic_get(&external_power)) {
+			if (current_power_mode != POWERED_MODE) {
+				current_power_mode = POWERED_MODE;
+				LOG_INF("Switching to POWERED mode");
+				sensors_power_mode(AS5600_POWER_MODE_NOM);
+				period_ms = POWERED_MODE_PERIOD_MS;
+				sample_timer_start(period_ms);
+			}
+		} else if (inactive_time >= DOZE_TIMEOUT_MS && current_power_mode != DOZE_MODE) {
 			current_power_mode = DOZE_MODE;
-			printk("Switching to DOZE mode\n");
-			regulator_disable(regulator_dev); // Power down sensor in DOZE mode, will be re-enabled on next loop
-			sleep_timeout = K_MSEC(DOZE_MODE_PERIOD_MS); // Reduce sampling rate in DOZE mode
+			LOG_INF("Switching to DOZE mode");
+			period_ms = DOZE_MODE_PERIOD_MS; // Reduce sampling rate in DOZE mode
+			sample_timer_start(period_ms);
 		} else if (inactive_time >= LPM_TIMEOUT_MS && current_power_mode != LPM_MODE) {
 			current_power_mode = LPM_MODE;
-			printk("Switching to LPM mode\n");
-			sensor_attr_set(sensor_dev, SENSOR_CHAN_ROTATION, AS5600_POWER_MODE, &(struct sensor_value){.val1 = AS5600_POWER_MODE_LPM2, .val2 = 0}); // Set low power mode
-			sleep_timeout = K_MSEC(LPM_MODE_PERIOD_MS); // Reduce sampling rate in LPM mode
+			LOG_INF("Switching to LPM mode");
+			sensors_power_mode(AS5600_POWER_MODE_LPM2); // Set low power mode
+			period_ms = LPM_MODE_PERIOD_MS; // Reduce sampling rate in LPM mode
+			sample_timer_start(period_ms);
 		} else if (inactive_time < LPM_TIMEOUT_MS && current_power_mode != ACTIVE_MODE) {
 			current_power_mode = ACTIVE_MODE;
-			printk("Switching to ACTIVE mode\n");
-			sensor_attr_set(sensor_dev, SENSOR_CHAN_ROTATION, AS5600_POWER_MODE, &(struct sensor_value){.val1 = AS5600_POWER_MODE_LPM1, .val2 = 0}); // Set active mode. LPM1 is default (sufficiently fast)
-			sleep_timeout = K_MSEC(ACTIVE_MODE_PERIOD_MS); // Restore normal sampling rate
+			LOG_INF("Switching to ACTIVE mode");
+			sensors_power_mode(AS5600_POWER_MODE_LPM1); // Set active mode. LPM1 is default (sufficiently fast)
+			period_ms = ACTIVE_MODE_PERIOD_MS; // Restore normal sampling rate
+			sample_timer_start(period_ms);
+		}
+
+		if (current_power_mode == ACTIVE_MODE) {
+			sample_sync_update();
 		}
     }
 }
 
-K_THREAD_DEFINE(sensor_data_collector_id, SENSOR_THREAD_STACKSIZE, sensor_data_collector, NULL, NULL, NULL, SENSOR_THREAD_PRIORITY, 0, 1000);
+/* Not started at boot, see magnetometer_start() */
+K_THREAD_DEFINE(sensor_data_collector_id, SENSOR_THREAD_STACKSIZE, sensor_data_collector, NULL, NULL, NULL, SENSOR_THREAD_PRIORITY, 0, SYS_FOREVER_MS);
+
+bool magnetometer_sync(uint32_t interval_us)
+{
+	uint32_t period_us = atomic_get(&sync_period_us);
+
+	atomic_set(&sync_interval_us, interval_us);
+
+	/* Not sampling, or not retimed for this interval yet */
+	if (period_us == 0 || interval_us == 0 || period_us % interval_us != 0) {
+		return false;
+	}
+
+	if (atomic_inc(&sync_events) + 1 < period_us / interval_us) {
+		return false;
+	}
+	atomic_clear(&sync_events);
+
+	/* Sample now and keep the period as a fallback for events the host skips */
+	k_timer_start(&sample_timer, K_NO_WAIT, K_USEC(period_us));
+
+	return true;
+}
+
+void magnetometer_external_power(bool on)
+{
+	atomic_set(&external_power, on);
+}
+
+void magnetometer_start(void)
+{
+	static atomic_t started;
+
+	if (atomic_cas(&started, 0, 1)) {
+		k_thread_start(sensor_data_collector_id);
+	}
+}
 
@@ -7,6 +7,7 @@
 #include <zephyr/kernel.h>
 #include <zephyr/drivers/gpio.h>
 #include <zephyr/drivers/adc.h>
+#include <zephyr/pm/device_runtime.h>
 #include <soc.h>
 #include <assert.h>
 
@@ -17,41 +18,62 @@
 #include <zephyr/bluetooth/conn.h>
 #include <zephyr/bluetooth/uuid.h>
 #include <zephyr/bluetooth/gatt.h>
+#include <zephyr/bluetooth/att.h>
 
 #include <zephyr/bluetooth/services/bas.h>
 #include <bluetooth/services/hids.h>
 #include <zephyr/bluetooth/services/dis.h>
-#include <dk_buttons_and_leds.h>
 #include <zephyr/logging/log.h>
 
 #include "pairing.h"
 #include "scroll.h"
+#include "magnetometer.h"
+#include "boot_profile.h"
+#include "host_slots.h"
+#include "shelf.h"
+#include "pacer.h"
+#include "personality.h"
+#include "settings_cache.h"
+#include "charger.h"
 
-LOG_MODULE_REGISTER(Scroll, LOG_LEVEL_DBG);
+LOG_MODULE_REGISTER(scroll, CONFIG_SCROLL_LOG_LEVEL);
 
 #define BASE_USB_HID_SPEC_VERSION   0x0101
 
-#define INPUT_REP_WHEEL_BTN_LEN 4
+#define INPUT_REP_WHEEL_BTN_LEN 5
 #define INPUT_REP_WHEEL_BTN_ID  1
 #define INPUT_REP_WHEEL_BTN_INDEX 0
 #define WHEEL_BYTE_INDEX 3
+#define PAN_BYTE_INDEX 4
+
+/* Radial controller: puck button, Dial and angle in hundredths of a degree */
+#define INPUT_REP_DIAL_LEN 5
+#define INPUT_REP_DIAL_ID 3
+#define INPUT_REP_DIAL_INDEX 1
+#define DIAL_CDEG_PER_REV 36000
 
 #define FEATURE_REP_RES_LEN 1
 #define FEATURE_REP_RES_ID 2
 #define FEATURE_REP_RES_INDEX 0
 
 
-/* HIDs queue size. */
-#define HIDS_QUEUE_SIZE 50
+/* HIDs queue size, see "diag sampling" for its high-water mark. */
+#define HIDS_QUEUE_SIZE CONFIG_SCROLL_QUEUE_SIZE
+
+/* Lengths of every registered report in registration order, sizes each connection's storage */
+#if CONFIG_SCROLL_DIAL
+#define HIDS_REPORT_LENS INPUT_REP_WHEEL_BTN_LEN, INPUT_REP_DIAL_LEN, FEATURE_REP_RES_LEN
+#else
+#define HIDS_REPORT_LENS INPUT_REP_WHEEL_BTN_LEN, FEATURE_REP_RES_LEN
+#endif
 
 /* HIDS instance. */
-BT_HIDS_DEF(hids_obj,
-	    INPUT_REP_WHEEL_BTN_LEN, FEATURE_REP_RES_LEN);
+BT_HIDS_DEF(hids_obj, HIDS_REPORT_LENS);
 
 struct k_work hids_work;
 
 K_MSGQ_DEFINE(scroll_queue,
-	      sizeof(int8_t),
+	      sizeof(struct scroll_event),
 	      HIDS_QUEUE_SIZE,
 	      4);
 
@@ -71,10 +93,11 @@ static const struct gpio_dt_spec blue_led = GPIO_DT_SPEC_GET(DT_ALIAS(led2), gpi
 static const struct gpio_dt_spec bm_switch = GPIO_DT_SPEC_GET(DT_PATH(gpios, bm_switch), gpios);
 
 bool bt_connected = false;
+int64_t scroll_activity_at;
 
 static void hids_pm_evt_handler(enum bt_hids_pm_evt evt, struct bt_conn *conn)
 {
-	char addr[BT_ADDR_LE_STR_LEN];
+	const bt_addr_le_t *addr = bt_conn_get_dst(conn);
 	size_t i;
 
 	for (i = 0; i < CONFIG_BT_HIDS_MAX_CLIENT_COUNT; i++) {
@@ -87,16 +110,14 @@ static void hids_pm_evt_handler(enum bt_hids_pm_evt evt, struct bt_conn *conn)
 		return;
 	}
 
-	bt_addr_le_to_str(bt_conn_get_dst(conn), addr, sizeof(addr));
-
 	switch (evt) {
 	case BT_HIDS_PM_EVT_BOOT_MODE_ENTERED:
-		printk("Boot mode entered %s\n", addr);
+		LOG_INF("Boot mode entered " ADDR_LE_FMT, ADDR_LE_ARGS(addr));
 		conn_mode[i].in_boot_mode = true;
 		break;
 
 	case BT_HIDS_PM_EVT_REPORT_MODE_ENTERED:
-		printk("Report mode entered %s\n", addr);
+		LOG_INF("Report mode entered " ADDR_LE_FMT, ADDR_LE_ARGS(addr));
 		conn_mode[i].in_boot_mode = false;
 		break;
 
@@ -107,17 +128,16 @@ static void hids_pm_evt_handler(enum bt_hids_pm_evt evt, struct bt_conn *conn)
 
 static void hid_feature_report_handler(struct bt_hids_rep *rep, struct bt_conn *conn, bool write)
 {
-	char addr[BT_ADDR_LE_STR_LEN];
+	const bt_addr_le_t *addr = bt_conn_get_dst(conn);
 
-	bt_addr_le_to_str(bt_conn_get_dst(conn), addr, sizeof(addr));
 	if (write) {
 		/* Host is reading the feature report - send current multiplier */
 		rep->data[0] = 1;//scroll_resolution_multiplier;
-		printk("HID Feature Report read by %s, sending multiplier: 1\n", addr);
+		LOG_INF("HID Feature Report read by " ADDR_LE_FMT ", sending multiplier: 1", ADDR_LE_ARGS(addr));
 	} else {
 		/* Host is writing the feature report - update multiplier */
 		//scroll_resolution_multiplier = rep->data[0];
-		printk("HID Feature Report written by %s, multiplier set to ON\n", addr);
+		LOG_INF("HID Feature Report written by " ADDR_LE_FMT ", multiplier set to ON", ADDR_LE_ARGS(addr));
 		hirez_enabled = true;
 	}
 }
@@ -178,9 +198,58 @@ static void hid_init(void)
 		0x25, 0x7F,        //       Logical Maximum (127)
 		0x75, 0x08,        //       Report Size (8)
 		0x81, 0x06,        //       Input (Data,Var,Rel,No Wrap,Linear,Preferred State,No Null Position)
+		// AC Pan, same report and resolution multiplier as the wheel
+		0x05, 0x0C,        //       Usage Page (Consumer)
+		0x0A, 0x38, 0x02,  //       Usage (AC Pan)
+		0x15, 0x81,        //       Logical Minimum (-127)
+		0x25, 0x7F,        //       Logical Maximum (127)
+		0x75, 0x08,        //       Report Size (8)
+		0x95, 0x01,        //       Report Count (1)
+		0x81, 0x06,        //       Input (Data,Var,Rel,No Wrap,Linear,Preferred State,No Null Position)
 		0xC0,              //     End Collection
 		0xC0,              //   End Collection
 		0xC0,              // End Collection
+#if CONFIG_SCROLL_DIAL
+		// Radial controller, last so its units do not carry into the mouse
+		0x05, 0x01,        // Usage Page (Generic Desktop Ctrls)
+		0x09, 0x0E,        // Usage (System Multi-Axis Controller)
+		0xA1, 0x01,        // Collection (Application)
+		0x85, 0x03,        //   Report ID (3)
+		0x05, 0x0D,        //   Usage Page (Digitizer)
+		0x09, 0x21,        //   Usage (Puck)
+		0xA1, 0x00,        //   Collection (Physical)
+		// Button
+		0x05, 0x09,        //     Usage Page (Button)
+		0x09, 0x01,        //     Usage (0x01)
+		0x95, 0x01,        //     Report Count (1)
+		0x75, 0x01,        //     Report Size (1)
+		0x15, 0x00,        //     Logical Minimum (0)
+		0x25, 0x01,        //     Logical Maximum (1)
+		0x81, 0x02,        //     Input (Data,Var,Abs,No Wrap,Linear,Preferred State,No Null Position)
+		// Padding
+		0x75, 0x07,        //     Report Size (7)
+		0x81, 0x01,        //     Input (Const,Array,Abs,No Wrap,Linear,Preferred State,No Null Position)
+		// Rotation since the last report, 0.01 degree
+		0x05, 0x01,        //     Usage Page (Generic Desktop Ctrls)
+		0x09, 0x37,        //     Usage (Dial)
+		0x55, 0x0E,        //     Unit Exponent (-2)
+		0x65, 0x14,        //     Unit (English Rotation: Degrees)
+		0x16, 0x01, 0x80,  //     Logical Minimum (-32767)
+		0x26, 0xFF, 0x7F,  //     Logical Maximum (32767)
+		0x36, 0x01, 0x80,  //     Physical Minimum (-32767)
+		0x46, 0xFF, 0x7F,  //     Physical Maximum (32767)
+		0x75, 0x10,        //     Report Size (16)
+		0x81, 0x06,        //     Input (Data,Var,Rel,No Wrap,Linear,Preferred State,No Null Position)
+		// Absolute angle, 0.01 degree
+		0x09, 0x35,        //     Usage (Rz)
+		0x15, 0x00,        //     Logical Minimum (0)
+		0x27, 0x9F, 0x8C, 0x00, 0x00, // Logical Maximum (35999)
+		0x35, 0x00,        //     Physical Minimum (0)
+		0x47, 0x9F, 0x8C, 0x00, 0x00, // Physical Maximum (35999)
+		0x81, 0x02,        //     Input (Data,Var,Abs,No Wrap,Linear,Preferred State,No Null Position)
+		0xC0,              //   End Collection
+		0xC0,              // End Collection
+#endif
 	};
 
 	
@@ -196,6 +265,13 @@ static void hid_init(void)
 	hids_inp_rep->id = INPUT_REP_WHEEL_BTN_ID;
 	hids_init_param.inp_rep_group_init.cnt++;
 
+#if CONFIG_SCROLL_DIAL
+	hids_inp_rep = &hids_init_param.inp_rep_group_init.reports[INPUT_REP_DIAL_INDEX];
+	hids_inp_rep->size = INPUT_REP_DIAL_LEN;
+	hids_inp_rep->id = INPUT_REP_DIAL_ID;
+	hids_init_param.inp_rep_group_init.cnt++;
+#endif
+
 /* Setup Feature Report for Resolution Multiplier */
 	struct bt_hids_outp_feat_rep *hids_feat_rep;
 	hids_feat_rep = &hids_init_param.feat_rep_group_init.reports[0];
@@ -211,58 +287,229 @@ static void hid_init(void)
 	__ASSERT(err == 0, "HIDS initialization failed\n");
 }
 
-static void mouse_scroll_send(int8_t scroll_delta)
+/*
+ * Input reports go out on an enhanced bearer once the host has opened one, so
+ * a pending read or indication on the unenhanced bearer never delays them.
+ * The HIDS library cannot choose a bearer and remains the fallback. It also
+ * keeps the copy returned to Input Report reads, which hosts only issue right
+ * after connecting, before any report is sent.
+ */
+static int hid_input_report_send(struct bt_conn *conn, uint8_t index,
+				 const uint8_t *rep, uint8_t len)
+{
+#if CONFIG_SCROLL_HID_EATT
+	if (conn && bt_eatt_count(conn) > 0) {
+		const struct bt_hids_inp_rep *inp_rep = &hids_obj.inp_rep_group.reports[index];
+		struct bt_gatt_notify_params params = {
+			.attr = &hids_obj.gp.svc.attrs[inp_rep->att_ind],
+			.data = rep,
+			.len = len,
+			.chan_opt = BT_ATT_CHAN_OPT_ENHANCED_ONLY,
+		};
+
+		return bt_gatt_notify_cb(conn, &params);
+	}
+#endif
+
+	return bt_hids_inp_rep_send(&hids_obj, conn, index, rep, len, NULL);
+}
+
+static struct hid_send_stats hid_send_stats;
+static const uint32_t hid_send_bucket_us[] = HID_SEND_BUCKET_BOUNDS_US;
+
+/* With bt_rpc the notify call returns once the network core has taken the report */
+static int hid_input_report_timed(struct bt_conn *conn, uint8_t index,
+				  const uint8_t *rep, uint8_t len)
+{
+	uint32_t start = k_cycle_get_32();
+	int err = hid_input_report_send(conn, index, rep, len);
+	uint32_t us = k_cyc_to_us_floor32(k_cycle_get_32() - start);
+	size_t bucket = 0;
+
+	while (bucket < ARRAY_SIZE(hid_send_bucket_us) && us >= hid_send_bucket_us[bucket]) {
+		bucket++;
+	}
+
+	hid_send_stats.calls++;
+	hid_send_stats.errors += (err != 0);
+	hid_send_stats.total_us += us;
+	hid_send_stats.max_us = MAX(hid_send_stats.max_us, us);
+	hid_send_stats.buckets[bucket]++;
+
+	return err;
+}
+
+void hid_send_stats_get(struct hid_send_stats *stats)
+{
+	*stats = hid_send_stats;
+}
+
+void hid_send_stats_reset(void)
 {
-	//printk("Sending scroll delta: %d\n", scroll_delta);
+	memset(&hid_send_stats, 0, sizeof(hid_send_stats));
+}
+
+static void first_report_mark(size_t i)
+{
+	if (!conn_mode[i].first_report_sent) {
+		conn_mode[i].first_report_sent = true;
+		LOG_INF("First report %u ms after connection",
+			(uint32_t)(k_uptime_get() - conn_mode[i].connected_at));
+	}
+}
+
+/*
+ * Several hosts in report mode and none on an enhanced bearer: a NULL
+ * connection notifies all of them in one call, which with bt_rpc is one
+ * round trip to the network core instead of one per host.
+ */
+static bool hid_input_report_batchable(void)
+{
+	size_t hosts = 0;
+
+	for (size_t i = 0; i < CONFIG_BT_HIDS_MAX_CLIENT_COUNT; i++) {
+		if (!conn_mode[i].conn) {
+			continue;
+		}
+
+		if (conn_mode[i].in_boot_mode) {
+			return false;
+		}
+#if CONFIG_SCROLL_HID_EATT
+		if (bt_eatt_count(conn_mode[i].conn) > 0) {
+			return false;
+		}
+#endif
+		hosts++;
+	}
+
+	return hosts > 1;
+}
+
+/* Send one input report to every host in report mode */
+static void hid_input_report_broadcast(uint8_t index, const uint8_t *rep, uint8_t len)
+{
+	if (hid_input_report_batchable()) {
+		if (hid_input_report_timed(NULL, index, rep, len) == 0) {
+			hid_send_stats.batched++;
+			for (size_t i = 0; i < CONFIG_BT_HIDS_MAX_CLIENT_COUNT; i++) {
+				if (conn_mode[i].conn) {
+					first_report_mark(i);
+				}
+			}
+		}
+		return;
+	}
+
 	for (size_t i = 0; i < CONFIG_BT_HIDS_MAX_CLIENT_COUNT; i++) {
 		if (!conn_mode[i].conn) {
 			continue;
 		}
 
 		if (!conn_mode[i].in_boot_mode) {
-			uint8_t buffer[INPUT_REP_WHEEL_BTN_LEN] = {0};
-			buffer[WHEEL_BYTE_INDEX] = scroll_delta;
+			int err = hid_input_report_timed(conn_mode[i].conn, index, rep, len);
 
-			bt_hids_inp_rep_send(&hids_obj, conn_mode[i].conn,
-						  INPUT_REP_WHEEL_BTN_INDEX,
-						  buffer, sizeof(buffer), NULL);
+			if (!err) {
+				first_report_mark(i);
+			}
 		}
 	}
 }
 
+static void mouse_scroll_send(const struct scroll_event *event)
+{
+	uint8_t buffer[INPUT_REP_WHEEL_BTN_LEN] = {0};
+
+	LOG_DBG("Sending scroll delta: %d, pan: %d", event->wheel, event->pan);
+	buffer[WHEEL_BYTE_INDEX] = event->wheel;
+	buffer[PAN_BYTE_INDEX] = event->pan;
+
+	hid_input_report_broadcast(INPUT_REP_WHEEL_BTN_INDEX, buffer, sizeof(buffer));
+}
+
+/* Dial rotation not yet sent, 1/16 counts times DIAL_CDEG_PER_REV */
+static int32_t dial_residue;
+static uint16_t dial_angle;
+static bool dial_button;
+
+/* Rotation in hundredths of a degree, the fraction carries over to the next sample */
+static int32_t dial_rotation_cdeg(int16_t rotation)
+{
+	int32_t cdeg;
+
+	dial_residue += rotation * DIAL_CDEG_PER_REV;
+	cdeg = dial_residue / SCROLL_COUNTS_PER_REV;
+	dial_residue -= cdeg * SCROLL_COUNTS_PER_REV;
+
+	return cdeg;
+}
+
+static void dial_send(int32_t rotation_cdeg)
+{
+	uint8_t buffer[INPUT_REP_DIAL_LEN];
+	uint16_t angle_cdeg = ((uint32_t)dial_angle * DIAL_CDEG_PER_REV) / SCROLL_COUNTS_PER_REV;
+
+	LOG_DBG("Sending dial: %d, angle: %u, button: %d", rotation_cdeg, angle_cdeg, dial_button);
+	buffer[0] = dial_button;
+	sys_put_le16(CLAMP(rotation_cdeg, -INT16_MAX, INT16_MAX), &buffer[1]);
+	sys_put_le16(angle_cdeg, &buffer[3]);
+
+	hid_input_report_broadcast(INPUT_REP_DIAL_INDEX, buffer, sizeof(buffer));
+}
+
+/*
+ * Several samples can queue up behind a busy workqueue, the pacer evens them
+ * out. Dial rotation skips the pacer: it is summed into a single report.
+ */
 static void mouse_handler(struct k_work *work)
 {
-	uint8_t scroll_delta;
-	while (!k_msgq_get(&scroll_queue, &scroll_delta, K_NO_WAIT)) {
-		mouse_scroll_send(scroll_delta);
+	struct scroll_event event;
+	int32_t dial_cdeg = 0;
+	bool dial_moved = false;
+
+	while (!k_msgq_get(&scroll_queue, &event, K_NO_WAIT)) {
+		scroll_activity_at = k_uptime_get();
+		if (IS_ENABLED(CONFIG_SCROLL_DIAL) && event.dial != 0) {
+			dial_cdeg += dial_rotation_cdeg(event.dial);
+			dial_angle = event.angle;
+			dial_moved = true;
+		}
+		if (event.wheel != 0 || event.pan != 0) {
+			pacer_push(&event);
+		}
+	}
+
+	if (dial_moved) {
+		dial_send(dial_cdeg);
 	}
 }
 
 void connected(struct bt_conn *conn, uint8_t err)
 {
-	char addr[BT_ADDR_LE_STR_LEN];
+	const bt_addr_le_t *addr = bt_conn_get_dst(conn);
 
 	is_adv_running = false;
 
-	bt_addr_le_to_str(bt_conn_get_dst(conn), addr, sizeof(addr));
-
 	if (err) {
 		if (err == BT_HCI_ERR_ADV_TIMEOUT) {
-			printk("Direct advertising to %s timed out\n", addr);
+			LOG_WRN("Direct advertising to " ADDR_LE_FMT " timed out", ADDR_LE_ARGS(addr));
 			k_work_submit(&adv_work);
 		} else {
-			printk("Failed to connect to %s 0x%02x %s\n", addr, err,
-			       bt_hci_err_to_str(err));
+			LOG_ERR("Failed to connect to " ADDR_LE_FMT " 0x%02x %s", ADDR_LE_ARGS(addr), err,
+				bt_hci_err_to_str(err));
 		}
 		return;
 	}
 
-	printk("Connected %s\n", addr);
+	LOG_INF("Connected " ADDR_LE_FMT, ADDR_LE_ARGS(addr));
+
+	/* The magnetometer stays unpowered until a host is there to use it */
+	magnetometer_start();
 
 	err = bt_hids_connected(&hids_obj, conn);
 
 	if (err) {
-		printk("Failed to notify HID service about connection\n");
+		LOG_ERR("Failed to notify HID service about connection");
 		return;
 	}
 
@@ -279,16 +526,14 @@ void connected(struct bt_conn *conn, uint8_t err)
 void disconnected(struct bt_conn *conn, uint8_t reason)
 {
 	int err;
-	char addr[BT_ADDR_LE_STR_LEN];
-
-	bt_addr_le_to_str(bt_conn_get_dst(conn), addr, sizeof(addr));
+	const bt_addr_le_t *addr = bt_conn_get_dst(conn);
 
-	printk("Disconnected from %s, reason 0x%02x %s\n", addr, reason, bt_hci_err_to_str(reason));
+	LOG_INF("Disconnected from " ADDR_LE_FMT ", reason 0x%02x %s", ADDR_LE_ARGS(addr), reason, bt_hci_err_to_str(reason));
 
 	err = bt_hids_disconnected(&hids_obj, conn);
 
 	if (err) {
-		printk("Failed to notify HID service about disconnection\n");
+		LOG_ERR("Failed to notify HID service about disconnection");
 	}
 
 	for (size_t i = 0; i < CONFIG_BT_HIDS_MAX_CLIENT_COUNT; i++) {
@@ -304,24 +549,137 @@ void disconnected(struct bt_conn *conn, uint8_t reason)
 	advertising_start();
 }
 
+/*
+ * Button gestures: N short clicks select host slot N, a long press forgets
+ * the active slot's host and starts pairing. Clicking the active slot only
+ * resumes advertising after a timeout.
+ */
+#define BUTTON_CLICK_WINDOW_MS 400
+#define BUTTON_LONG_PRESS_MS 3000
+/* Poll period while the button is held, also the debounce time */
+#define BUTTON_SCAN_MS 10
+
+static const struct gpio_dt_spec button = GPIO_DT_SPEC_GET(DT_PATH(buttons, button), gpios);
+static struct gpio_callback button_cb;
+static struct k_work_delayable button_scan_work;
+static bool button_level;
+
+static struct k_work_delayable button_gesture_work;
+static uint8_t button_clicks;
+static bool button_down;
+static int64_t button_pressed_at;
+
+static void button_gesture(struct k_work *work)
+{
+	uint8_t clicks = button_clicks;
+
+	button_clicks = 0;
+	if (clicks == 0) {
+		return;
+	}
+
+	host_slot_select(clicks - 1);
+}
+
 void button_changed(uint32_t button_state, uint32_t has_changed)
 {
-	uint32_t buttons = button_state & has_changed;
-	printk("Button state changed: 0x%08X, changed: 0x%08X\n", button_state, has_changed);
+	LOG_DBG("Button state changed: 0x%08X, changed: 0x%08X", button_state, has_changed);
+
+	if (!has_changed) {
+		return;
+	}
+
+	if (button_state & has_changed) {
+		/* The press that woke the device from System OFF is not a click */
+		if (shelf_woke() && k_uptime_get() < SHELF_WAKE_PRESS_MS) {
+			return;
+		}
+		/* The puck button belongs to the host, gestures wait for the wheel personality */
+		if (hid_personality_get() == HID_PERSONALITY_DIAL) {
+			dial_button = true;
+			dial_send(0);
+			return;
+		}
+		button_down = true;
+		button_pressed_at = k_uptime_get();
+		k_work_cancel_delayable(&button_gesture_work);
+		return;
+	}
+
+	if (dial_button) {
+		dial_button = false;
+		dial_send(0);
+		return;
+	}
+
+	if (!button_down) {
+		return;
+	}
+	button_down = false;
+
+	if (k_uptime_get() - button_pressed_at >= BUTTON_LONG_PRESS_MS) {
+		button_clicks = 0;
+		host_slot_clear();
+		return;
+	}
+
+	button_clicks++;
+	k_work_reschedule(&button_gesture_work, K_MSEC(BUTTON_CLICK_WINDOW_MS));
+}
+
+/*
+ * A level interrupt starts the scan, which polls the pin until it is
+ * released, so no GPIOTE channel stays enabled while the button is idle.
+ */
+static void button_scan(struct k_work *work)
+{
+	int val = gpio_pin_get_dt(&button);
+
+	if (val < 0) {
+		return;
+	}
+
+	if (val != button_level) {
+		button_level = val;
+		button_changed(val ? BIT(0) : 0, BIT(0));
+	}
 
-	if (buttons) {
-		bt_unpair(BT_ID_DEFAULT, BT_ADDR_LE_ANY);
-		printk("Cleared all connections\n");
+	if (val) {
+		k_work_reschedule(&button_scan_work, K_MSEC(BUTTON_SCAN_MS));
+	} else {
+		gpio_pin_interrupt_configure_dt(&button, GPIO_INT_LEVEL_ACTIVE);
 	}
 }
 
+static void button_pressed(const struct device *port, struct gpio_callback *cb,
+			   gpio_port_pins_t pins)
+{
+	gpio_pin_interrupt_configure_dt(&button, GPIO_INT_DISABLE);
+	k_work_reschedule(&button_scan_work, K_MSEC(BUTTON_SCAN_MS));
+}
+
 void configure_buttons(void)
 {
 	int err;
 
-	err = dk_buttons_init(button_changed);
+	k_work_init_delayable(&button_gesture_work, button_gesture);
+	k_work_init_delayable(&button_scan_work, button_scan);
+
+	if (!gpio_is_ready_dt(&button)) {
+		LOG_ERR("Button GPIO not ready");
+		return;
+	}
+
+	err = gpio_pin_configure_dt(&button, GPIO_INPUT);
+	if (!err) {
+		gpio_init_callback(&button_cb, button_pressed, BIT(button.pin));
+		err = gpio_add_callback_dt(&button, &button_cb);
+	}
+	if (!err) {
+		err = gpio_pin_interrupt_configure_dt(&button, GPIO_INT_LEVEL_ACTIVE);
+	}
 	if (err) {
-		printk("Cannot init buttons (err: %d)\n", err);
+		LOG_ERR("Cannot init buttons (err: %d)", err);
 	}
 }
 
@@ -384,22 +742,40 @@ static uint8_t voltage_to_battery_percentage(int32_t voltage_mv)
 static void bas_notify(void)
 {
 	static uint8_t battery_level = 100;
+	static enum charger_state prev_charger_state = CHARGER_BATTERY;
+	enum charger_state charger_state = charger_state_get();
+	uint8_t level;
 	int	err;
 	int32_t val_mv = 0;
 
+	/* Charge terminated: the cell is full, no need to measure it */
+	if (charger_state == CHARGER_EXTERNAL) {
+		prev_charger_state = charger_state;
+		battery_level = 100;
+		bt_bas_set_battery_level(battery_level);
+		return;
+	}
+
 	// If battery level is below 10%, blink red LED
 	if (battery_level < 10) {
 		gpio_pin_set_dt(&red_led, 1);
 	}
 	gpio_pin_set_dt(&bm_switch, 1);
-	
-	err = adc_read(bat_adc_channel.dev, &sequence);
+
+	/* SAADC is suspended between the once-a-second battery reads */
+	err = pm_device_runtime_get(bat_adc_channel.dev);
+	if (err == 0) {
+		err = adc_read(bat_adc_channel.dev, &sequence);
+		pm_device_runtime_put(bat_adc_channel.dev);
+	}
 	if (err < 0) {
 		LOG_ERR("Could not read (%d)", err);
+		gpio_pin_set_dt(&red_led, 0);
+		gpio_pin_set_dt(&bm_switch, 0);
 		return;
 	}
 
-	//LOG_DBG("ADC raw value: %X", bat_adc_buf);
+	LOG_DBG("ADC raw value: %X", bat_adc_buf);
 
 	val_mv = bat_adc_buf;
 	err = adc_raw_to_millivolts_dt(&bat_adc_channel, &val_mv);
@@ -407,19 +783,37 @@ static void bas_notify(void)
 	val_mv /= 51;
 	/* conversion to mV may not be supported, skip if not */
 	if (err < 0) {
-	    LOG_ERR(" (value in mV not available)\n");
+		LOG_ERR("Battery voltage in mV not available");
 	} else {
-		//LOG_DBG("Battery voltage = %d mV\n", val_mv);
+		LOG_DBG("Battery voltage = %d mV", val_mv);
 	}
 
 	gpio_pin_set_dt(&red_led, 0);
 	gpio_pin_set_dt(&bm_switch, 0);
 
-	battery_level = voltage_to_battery_percentage(val_mv);
-	//LOG_INF("Battery level: %d%%\n", battery_level);
+#if CONFIG_SCROLL_CHARGER
+	if (charger_state == CHARGER_CHARGING) {
+		val_mv -= CONFIG_SCROLL_CHARGER_OFFSET_MV;
+	}
+#endif
+	level = voltage_to_battery_percentage(val_mv);
+
+	/* Never 100% before the charger says so, and never falling while it charges */
+	if (charger_state == CHARGER_CHARGING) {
+		level = MIN(level, 99);
+		if (prev_charger_state == CHARGER_CHARGING) {
+			level = MAX(level, battery_level);
+		}
+	}
+	prev_charger_state = charger_state;
+
+	battery_level = level;
+	LOG_DBG("Battery level: %d%%", battery_level);
 	bt_bas_set_battery_level(battery_level);
+	shelf_retain_battery(battery_level);
 }
 
+#if CONFIG_SOC_SERIES_NRF52X
 static bool write_word_to_uicr(volatile uint32_t * addr, uint32_t word)
 {
     if (*addr == word)
@@ -441,25 +835,26 @@ static bool write_word_to_uicr(volatile uint32_t * addr, uint32_t word)
         NVIC_SystemReset();
     }
 }
+#endif
 
 void adc_init(void)
 {
 	int ret;
 
 	if (!adc_is_ready_dt(&bat_adc_channel)) {
-		printk("ADC device not ready\n");
+		LOG_ERR("ADC device not ready");
 		return;
 	}
 
 	ret = adc_channel_setup_dt(&bat_adc_channel);
 	if (ret < 0) {
-		printk("Failed to setup ADC channel (err %d)\n", ret);
+		LOG_ERR("Failed to setup ADC channel (err %d)", ret);
 		return;
 	}
 
 	int	err = adc_sequence_init_dt(&bat_adc_channel, &sequence);
 	if (err < 0) {
-		printk("Could not initalize sequnce\n");
+		LOG_ERR("Could not initalize sequnce");
 		return;
 	}
 }
@@ -469,39 +864,39 @@ void gpio_init(void)
 	int ret;
 
 	if (!gpio_is_ready_dt(&red_led)) {
-		printk("Red LED device not ready\n");
+		LOG_ERR("Red LED device not ready");
 		return;
 	}
 	ret = gpio_pin_configure_dt(&red_led, GPIO_OUTPUT_INACTIVE);
 	if (ret < 0) {
-		printk("Failed to configure red LED pin\n");
+		LOG_ERR("Failed to configure red LED pin");
 		return;
 	}
 	if (!gpio_is_ready_dt(&green_led)) {
-		printk("Green LED device not ready\n");
+		LOG_ERR("Green LED device not ready");
 		return;
 	}
 	ret = gpio_pin_configure_dt(&green_led, GPIO_OUTPUT_ACTIVE);
 	if (ret < 0) {
-		printk("Failed to configure green LED pin\n");
+		LOG_ERR("Failed to configure green LED pin");
 		return;
 	}
 	if (!gpio_is_ready_dt(&blue_led)) {
-		printk("Blue LED device not ready\n");
+		LOG_ERR("Blue LED device not ready");
 		return;
 	}
 	ret = gpio_pin_configure_dt(&blue_led, GPIO_OUTPUT_INACTIVE);
 	if (ret < 0) {
-		printk("Failed to configure blue LED pin\n");
+		LOG_ERR("Failed to configure blue LED pin");
 		return;
 	}
 	if (!gpio_is_ready_dt(&bm_switch)) {
-		printk("BM Switch device not ready\n");
+		LOG_ERR("BM Switch device not ready");
 		return;
 	}
 	ret = gpio_pin_configure_dt(&bm_switch, GPIO_OUTPUT_INACTIVE);
 	if (ret < 0) {
-		printk("Failed to configure BM Switch pin\n");
+		LOG_ERR("Failed to configure BM Switch pin");
 		return;
 	}
 }
@@ -516,20 +911,51 @@ void count_handler(const struct bt_bond_info *info, void *user_data)
 int bonds_count(void)
 {
 	int count = 0;
-	bt_foreach_bond(BT_ID_DEFAULT, count_handler, &count);
+	bt_foreach_bond(host_slot_active(), count_handler, &count);
 	return count;
 }
 
+/* Runs on the system workqueue once the host is up: the shortest path to advertising */
+static void bt_ready(int err)
+{
+	if (err) {
+		LOG_ERR("Bluetooth init failed (err %d)", err);
+		return;
+	}
+
+	boot_profile_mark(BOOT_STAGE_BT_READY);
+	LOG_INF("Bluetooth initialized");
+
+	/* Identity and bonds must be loaded before the first advertising set */
+	if (IS_ENABLED(CONFIG_SETTINGS)) {
+		/* Without the cache the records are still saved, only at once */
+		err = settings_cache_init();
+		if (err) {
+			LOG_WRN("Settings cache not installed, saving directly (err %d)", err);
+		}
+		settings_load();
+		boot_profile_mark(BOOT_STAGE_SETTINGS);
+	}
+
+	host_slots_init();
+
+	advertising_start();
+}
+
 int main(void)
 {
 	int err;
 
+	boot_profile_mark(BOOT_STAGE_MAIN);
+	shelf_init();
+
+#if CONFIG_SOC_SERIES_NRF52X
+	/* Only compares on every boot; writes and resets once on a fresh chip */
 	write_word_to_uicr(&NRF_UICR->PSELRESET[0], 0);
 	write_word_to_uicr(&NRF_UICR->PSELRESET[1], 0);
+#endif
 
-	gpio_init();
-
-	printk("Starting Bluetooth Peripheral HIDS mouse example\n");
+	LOG_INF("Starting Bluetooth Peripheral HIDS mouse example");
 
 	if (IS_ENABLED(CONFIG_BT_HIDS_SECURITY_ENABLED)) {
 		register_auth_callbacks();
@@ -538,26 +964,31 @@ int main(void)
 	/* DIS initialized at system boot with SYS_INIT macro. */
 	hid_init();
 
-	err = bt_enable(NULL);
-	if (err) {
-		printk("Bluetooth init failed (err %d)\n", err);
-		return 0;
+	/* Hosts read the battery right after connecting, answer before the first ADC read */
+	if (shelf_woke()) {
+		bt_bas_set_battery_level(shelf_retained_battery());
 	}
 
-	printk("Bluetooth initialized\n");
-
 	k_work_init(&hids_work, mouse_handler);
+	pacer_init(mouse_scroll_send);
 	register_pairing_work();
 
-	if (IS_ENABLED(CONFIG_SETTINGS)) {
-		settings_load();
+	err = bt_enable(bt_ready);
+	if (err) {
+		LOG_ERR("Bluetooth init failed (err %d)", err);
+		return 0;
 	}
+	boot_profile_mark(BOOT_STAGE_BT_ENABLE);
 
+	/* Everything below is off the critical path and overlaps with host init */
+	gpio_init();
 	adc_init();
-
-	advertising_start();
-
 	configure_buttons();
+	err = charger_init();
+	if (err) {
+		LOG_ERR("Cannot init charger status (err %d)", err);
+	}
+	boot_profile_mark(BOOT_STAGE_PERIPHERALS);
 
 	while (1) {
 		k_sleep(K_SECONDS(1));
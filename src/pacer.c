@@ -0,0 +1,184 @@
+#include <zephyr/kernel.h>
+#include <zephyr/bluetooth/conn.h>
+#include <zephyr/logging/log.h>
+#include <stdlib.h>
+
+#include "pacer.h"
+#include "pairing.h"
+
+LOG_MODULE_REGISTER(pacer, CONFIG_SCROLL_LOG_LEVEL);
+
+/* Rates are ticks per interval in 1/256 ticks */
+#define PACER_ONE 256
+
+enum {
+	PACER_WHEEL,
+	PACER_PAN,
+	PACER_AXES
+};
+
+struct pacer_axis {
+	int32_t backlog;  /* ticks received but not sent */
+	int32_t input;    /* ticks received this interval */
+	int32_t rate;     /* smoothed input per interval, Q8 */
+	int32_t quota;    /* fractional ticks owed by the rate, Q8 */
+	uint8_t quiet;    /* intervals since the last input */
+};
+
+static struct pacer_axis pacer_axes[PACER_AXES];
+static pacer_send_t pacer_send;
+static struct k_work_delayable pacer_work;
+static uint32_t interval_us = PACER_DEFAULT_INTERVAL_US;
+static uint8_t idle_intervals;
+static bool ticking;
+static struct pacer_stats pacer_stats;
+
+/* Pace to the first host's connection interval, reports go out once per event */
+static void interval_update(void)
+{
+	struct bt_conn_info info;
+
+	for (size_t i = 0; i < CONFIG_BT_HIDS_MAX_CLIENT_COUNT; i++) {
+		if (conn_mode[i].conn && bt_conn_get_info(conn_mode[i].conn, &info) == 0) {
+			interval_us = BT_CONN_INTERVAL_TO_US(info.le.interval);
+			return;
+		}
+	}
+}
+
+static int8_t report_clamp(int32_t ticks)
+{
+	return (int8_t)CLAMP(ticks, INT8_MIN + 1, INT8_MAX);
+}
+
+/* Ticks to send this interval for one axis */
+static int32_t axis_step(struct pacer_axis *axis)
+{
+	int32_t step;
+	int32_t lag_limit;
+	int32_t extra;
+
+	axis->rate += (axis->input * PACER_ONE - axis->rate) / (1 << PACER_RATE_SHIFT);
+	/* The division truncates, without input the rate would stop short of zero */
+	if (axis->input == 0 && abs(axis->rate) < (1 << PACER_RATE_SHIFT)) {
+		axis->rate = 0;
+	}
+	axis->quiet = axis->input != 0 ? 0 : MIN(axis->quiet + 1, UINT8_MAX);
+	axis->input = 0;
+
+	if (axis->backlog == 0) {
+		axis->quota = 0;
+		return 0;
+	}
+
+	/* The wheel has stopped: pacing what is left would only show as lag */
+	if (axis->quiet >= PACER_STOP_INTERVALS || axis->rate == 0) {
+		axis->quota = 0;
+		return axis->backlog;
+	}
+
+	/* Reversal: the old motion is stale, send what is left at once */
+	if ((axis->backlog > 0) != (axis->rate > 0)) {
+		pacer_stats.reversals++;
+		axis->rate = 0;
+		axis->quota = 0;
+		return axis->backlog;
+	}
+
+	/* Whole ticks owed at the measured rate, the fraction carries over */
+	axis->quota += axis->rate;
+	step = axis->quota / PACER_ONE;
+	axis->quota -= step * PACER_ONE;
+
+	/* Fell behind a sudden speed-up: close half the gap now */
+	lag_limit = (abs(axis->rate) * PACER_MAX_LAG_INTERVALS) / PACER_ONE;
+	extra = (axis->backlog - step) / 2;
+	if (abs(axis->backlog - step) > lag_limit && extra != 0) {
+		step += extra;
+		pacer_stats.catchups++;
+	}
+
+	if (abs(step) > abs(axis->backlog)) {
+		step = axis->backlog;
+		axis->quota = 0;
+	}
+
+	return step;
+}
+
+static void pacer_tick(struct k_work *work)
+{
+	struct scroll_event event;
+	int32_t steps[PACER_AXES];
+	bool active = false;
+
+	for (size_t i = 0; i < PACER_AXES; i++) {
+		struct pacer_axis *axis = &pacer_axes[i];
+
+		active |= (axis->input != 0);
+		steps[i] = report_clamp(axis_step(axis));
+		axis->backlog -= steps[i];
+		active |= (axis->backlog != 0);
+	}
+
+	if (steps[PACER_WHEEL] != 0 || steps[PACER_PAN] != 0) {
+		event.wheel = steps[PACER_WHEEL];
+		event.pan = steps[PACER_PAN];
+		pacer_send(&event);
+		pacer_stats.reports++;
+	}
+
+	idle_intervals = active ? 0 : idle_intervals + 1;
+	if (idle_intervals >= PACER_IDLE_INTERVALS) {
+		for (size_t i = 0; i < PACER_AXES; i++) {
+			pacer_axes[i].rate = 0;
+			pacer_axes[i].quota = 0;
+		}
+		ticking = false;
+		return;
+	}
+
+	k_work_schedule(&pacer_work, K_USEC(interval_us));
+}
+
+void pacer_push(const struct scroll_event *event)
+{
+	const int8_t ticks[PACER_AXES] = {
+		[PACER_WHEEL] = event->wheel,
+		[PACER_PAN] = event->pan,
+	};
+
+	if (!ticking) {
+		/* First motion after a pause goes out right away, pacing starts from the next interval */
+		interval_update();
+		pacer_stats.interval_us = MIN(interval_us, UINT16_MAX);
+		pacer_stats.bursts++;
+		pacer_send(event);
+		for (size_t i = 0; i < PACER_AXES; i++) {
+			pacer_axes[i].input = ticks[i];
+		}
+		idle_intervals = 0;
+		ticking = true;
+		k_work_schedule(&pacer_work, K_USEC(interval_us));
+		return;
+	}
+
+	for (size_t i = 0; i < PACER_AXES; i++) {
+		struct pacer_axis *axis = &pacer_axes[i];
+
+		axis->backlog += ticks[i];
+		axis->input += ticks[i];
+		pacer_stats.max_backlog = MAX(pacer_stats.max_backlog, (uint16_t)abs(axis->backlog));
+	}
+}
+
+void pacer_stats_get(struct pacer_stats *stats)
+{
+	*stats = pacer_stats;
+}
+
+void pacer_init(pacer_send_t send)
+{
+	pacer_send = send;
+	k_work_init_delayable(&pacer_work, pacer_tick);
+}
@@ -16,13 +16,20 @@
 #include <zephyr/bluetooth/conn.h>
 #include <zephyr/bluetooth/uuid.h>
 #include <zephyr/bluetooth/gatt.h>
+#include <zephyr/bluetooth/att.h>
 
 #include <zephyr/bluetooth/services/bas.h>
 #include <bluetooth/services/hids.h>
 #include <zephyr/bluetooth/services/dis.h>
-#include <dk_buttons_and_leds.h>
+#include <zephyr/logging/log.h>
 
 #include "pairing.h"
+#include "boot_profile.h"
+#include "magnetometer.h"
+#include "host_slots.h"
+#include "shelf.h"
+
+LOG_MODULE_REGISTER(pairing, CONFIG_PAIRING_LOG_LEVEL);
 
 
 #define DEVICE_NAME     CONFIG_BT_DEVICE_NAME
@@ -69,96 +76,429 @@ K_MSGQ_DEFINE(mitm_queue,
 
 static void num_comp_reply(bool accept);
 
-#if CONFIG_BT_DIRECTED_ADVERTISING
-static void bond_find(const struct bt_bond_info *info, void *user_data)
-{
-	int err;
+static int64_t adv_started_at;
+
+/*
+ * Each profile advertises in a fast burst, steps down to a slow interval and
+ * then stops until the wheel is moved or the button is pressed. Bonded hosts
+ * scan for the wheel on their own, so the reconnect burst is short and dense;
+ * pairing stays visible long enough to open the host's Bluetooth settings.
+ */
+struct adv_profile {
+	uint16_t fast_int_min;
+	uint16_t fast_int_max;
+	uint32_t fast_ms;
+	uint16_t slow_int_min;
+	uint16_t slow_int_max;
+	uint32_t slow_ms;
+};
 
-	/* Filter already connected peers. */
+static const struct adv_profile adv_profiles[ADV_PROFILE_COUNT] = {
+	[ADV_PROFILE_RECONNECT] = {
+		.fast_int_min = BT_GAP_ADV_FAST_INT_MIN_1,	/* 30 ms */
+		.fast_int_max = BT_GAP_ADV_FAST_INT_MAX_1,	/* 60 ms */
+		.fast_ms = CONFIG_SCROLL_ADV_RECONNECT_FAST_MS,
+		.slow_int_min = BT_GAP_ADV_SLOW_INT_MIN,	/* 1 s */
+		.slow_int_max = BT_GAP_ADV_SLOW_INT_MAX,	/* 1.2 s */
+		.slow_ms = CONFIG_SCROLL_ADV_RECONNECT_SLOW_MS,
+	},
+	[ADV_PROFILE_PAIRING] = {
+		.fast_int_min = BT_GAP_ADV_FAST_INT_MIN_2,	/* 100 ms */
+		.fast_int_max = BT_GAP_ADV_FAST_INT_MAX_2,	/* 150 ms */
+		.fast_ms = CONFIG_SCROLL_ADV_PAIRING_FAST_MS,
+		.slow_int_min = BT_GAP_ADV_SLOW_INT_MIN,
+		.slow_int_max = BT_GAP_ADV_SLOW_INT_MAX,
+		.slow_ms = CONFIG_SCROLL_ADV_PAIRING_SLOW_MS,
+	},
+};
+
+static struct {
+	enum adv_profile_id profile;
+	enum adv_phase phase;
+	bool timed;		/* a scheduled (not directed) set is running */
+	int64_t phase_started_at;
+} adv_sched;
+
+static struct adv_stats adv_stats;
+static struct k_work_delayable adv_phase_work;
+
+static bool is_peer_connected(const bt_addr_le_t *addr)
+{
 	for (size_t i = 0; i < CONFIG_BT_HIDS_MAX_CLIENT_COUNT; i++) {
 		if (conn_mode[i].conn) {
 			const bt_addr_le_t *dst =
 				bt_conn_get_dst(conn_mode[i].conn);
 
-			if (!bt_addr_le_cmp(&info->addr, dst)) {
-				return;
+			if (!bt_addr_le_cmp(addr, dst)) {
+				return true;
 			}
 		}
 	}
 
+	return false;
+}
+
+static void adv_param_set(struct bt_le_adv_param *param, enum adv_profile_id profile)
+{
+	const struct adv_profile *p = &adv_profiles[profile];
+
+	if (adv_sched.phase == ADV_PHASE_SLOW) {
+		param->interval_min = p->slow_int_min;
+		param->interval_max = p->slow_int_max;
+	} else {
+		param->interval_min = p->fast_int_min;
+		param->interval_max = p->fast_int_max;
+	}
+}
+
+/* Book the time spent in the current phase */
+static void adv_time_account(void)
+{
+	uint32_t elapsed;
+
+	if (!adv_sched.timed) {
+		return;
+	}
+
+	elapsed = (uint32_t)k_uptime_delta(&adv_sched.phase_started_at);
+	if (adv_sched.phase == ADV_PHASE_SLOW) {
+		adv_stats.slow_ms[adv_sched.profile] += elapsed;
+	} else {
+		adv_stats.fast_ms[adv_sched.profile] += elapsed;
+	}
+	adv_sched.timed = false;
+}
+
+static void adv_phase_begin(enum adv_profile_id profile)
+{
+	const struct adv_profile *p = &adv_profiles[profile];
+	uint32_t duration = (adv_sched.phase == ADV_PHASE_SLOW) ? p->slow_ms : p->fast_ms;
+
+	adv_sched.profile = profile;
+	adv_sched.phase_started_at = k_uptime_get();
+	adv_sched.timed = true;
+	k_work_reschedule(&adv_phase_work, K_MSEC(duration));
+}
+
+static int adv_stop(void)
+{
+	int err;
+
+	if (!is_adv_running) {
+		return 0;
+	}
+
+	err = bt_le_adv_stop();
+	if (err) {
+		LOG_ERR("Advertising failed to stop (err %d)", err);
+		return err;
+	}
+
+	is_adv_running = false;
+	adv_time_account();
+
+	return 0;
+}
+
+#if CONFIG_BT_DIRECTED_ADVERTISING
+static void bond_find(const struct bt_bond_info *info, void *user_data)
+{
+	int err;
+
+	/* Filter already connected peers. */
+	if (is_peer_connected(&info->addr)) {
+		return;
+	}
+
 	err = k_msgq_put(&bonds_queue, (void *) &info->addr, K_NO_WAIT);
 	if (err) {
-		printk("No space in the queue for the bond.\n");
+		LOG_ERR("No space in the queue for the bond.");
 	}
 }
 #endif
 
+#if CONFIG_SCROLL_RECONNECT_ACCEPT_LIST
+static bool reconnect_requested;
+
+static void accept_list_add(const struct bt_bond_info *info, void *user_data)
+{
+	int *count = user_data;
+
+	if (is_peer_connected(&info->addr)) {
+		return;
+	}
+
+	if (bt_le_filter_accept_list_add(&info->addr) == 0) {
+		(*count)++;
+	}
+}
+
+/*
+ * Advertise to every bonded, not yet connected host at once. Only hosts in
+ * the filter accept list may connect, so a sleeping laptop that wakes up
+ * reconnects on its first scan instead of waiting for its turn in a
+ * per-peer directed advertising cycle.
+ */
+static int reconnect_advertising_start(void)
+{
+	struct bt_le_adv_param adv_param = *BT_LE_ADV_CONN;
+	int count = 0;
+	int err;
+
+	/* The accept list cannot change while an advertising set uses it */
+	err = adv_stop();
+	if (err) {
+		return err;
+	}
+
+	err = bt_le_filter_accept_list_clear();
+	if (err) {
+		LOG_ERR("Cannot clear accept list (err %d)", err);
+		return err;
+	}
+
+	bt_foreach_bond(host_slot_active(), accept_list_add, &count);
+	if (count == 0) {
+		return -ENOENT;
+	}
+
+	adv_param.options |= BT_LE_ADV_OPT_ONE_TIME |
+			     BT_LE_ADV_OPT_FILTER_CONN |
+			     BT_LE_ADV_OPT_FILTER_SCAN_REQ;
+	adv_param_set(&adv_param, ADV_PROFILE_RECONNECT);
+	adv_param.id = host_slot_active();
+
+	err = bt_le_adv_start(&adv_param, ad, ARRAY_SIZE(ad), sd, ARRAY_SIZE(sd));
+	if (err) {
+		LOG_ERR("Reconnect advertising failed to start (err %d)", err);
+		return err;
+	}
+
+	LOG_INF("Reconnect advertising to %d bonded hosts started", count);
+
+	return 0;
+}
+
+static bool directed_requested;
+
+static void bond_first(const struct bt_bond_info *info, void *user_data)
+{
+	bt_addr_le_t *addr = user_data;
+
+	if (!bt_addr_le_cmp(addr, BT_ADDR_LE_ANY)) {
+		bt_addr_le_copy(addr, &info->addr);
+	}
+}
+
+/*
+ * High duty cycle directed advertising to the host of the active slot, used
+ * right after a slot switch. The host connects within a few connection
+ * events if it is scanning; otherwise the set times out after 1.28 s and
+ * the accept list takes over.
+ */
+static int directed_advertising_start(void)
+{
+	struct bt_le_adv_param adv_param;
+	bt_addr_le_t addr;
+	int err;
+
+	bt_addr_le_copy(&addr, BT_ADDR_LE_ANY);
+	bt_foreach_bond(host_slot_active(), bond_first, &addr);
+	if (!bt_addr_le_cmp(&addr, BT_ADDR_LE_ANY)) {
+		return -ENOENT;
+	}
+
+	err = adv_stop();
+	if (err) {
+		return err;
+	}
+
+	adv_param = *BT_LE_ADV_CONN_DIR(&addr);
+	adv_param.options |= BT_LE_ADV_OPT_DIR_ADDR_RPA;
+	adv_param.id = host_slot_active();
+
+	err = bt_le_adv_start(&adv_param, NULL, 0, NULL, 0);
+	if (err) {
+		LOG_ERR("Directed advertising failed to start (err %d)", err);
+		return err;
+	}
+
+	LOG_INF("Direct advertising to " ADDR_LE_FMT " started", ADDR_LE_ARGS(&addr));
+
+	return 0;
+}
+#endif
+
 static void advertising_continue(void)
 {
 	struct bt_le_adv_param adv_param;
 
+	if (adv_sched.phase == ADV_PHASE_STOPPED) {
+		return;
+	}
+
+#if CONFIG_SCROLL_RECONNECT_ACCEPT_LIST
+	if (directed_requested) {
+		directed_requested = false;
+
+		if (!directed_advertising_start()) {
+			is_adv_running = true;
+			return;
+		}
+	}
+
+	if (reconnect_requested) {
+		reconnect_requested = false;
+
+		if (!reconnect_advertising_start()) {
+			is_adv_running = true;
+			adv_phase_begin(ADV_PROFILE_RECONNECT);
+			boot_profile_mark(BOOT_STAGE_ADV);
+			return;
+		}
+	}
+#endif
+
 #if CONFIG_BT_DIRECTED_ADVERTISING
 	bt_addr_le_t addr;
 
 	if (!k_msgq_get(&bonds_queue, &addr, K_NO_WAIT)) {
-		char addr_buf[BT_ADDR_LE_STR_LEN];
 		int err;
 
-		if (is_adv_running) {
-			err = bt_le_adv_stop();
-			if (err) {
-				printk("Advertising failed to stop (err %d)\n", err);
-				return;
-			}
-			is_adv_running = false;
+		err = adv_stop();
+		if (err) {
+			return;
 		}
 
 		adv_param = *BT_LE_ADV_CONN_DIR(&addr);
 		adv_param.options |= BT_LE_ADV_OPT_DIR_ADDR_RPA;
+		adv_param.id = host_slot_active();
 
 		err = bt_le_adv_start(&adv_param, NULL, 0, NULL, 0);
 
 		if (err) {
-			printk("Directed advertising failed to start (err %d)\n", err);
+			LOG_ERR("Directed advertising failed to start (err %d)", err);
 			return;
 		}
 
-		bt_addr_le_to_str(&addr, addr_buf, BT_ADDR_LE_STR_LEN);
-		printk("Direct advertising to %s started\n", addr_buf);
+		LOG_INF("Direct advertising to " ADDR_LE_FMT " started", ADDR_LE_ARGS(&addr));
 	} else
 #endif
 	{
 		int err;
 
-		if (is_adv_running) {
+		/* Restart from the current phase rather than keep a stale interval */
+		err = adv_stop();
+		if (err) {
 			return;
 		}
 
 		adv_param = *BT_LE_ADV_CONN;
 		adv_param.options |= BT_LE_ADV_OPT_ONE_TIME;
+		adv_param_set(&adv_param, ADV_PROFILE_PAIRING);
+		adv_param.id = host_slot_active();
 		err = bt_le_adv_start(&adv_param, ad, ARRAY_SIZE(ad),
 				  sd, ARRAY_SIZE(sd));
 		if (err) {
-			printk("Advertising failed to start (err %d)\n", err);
+			LOG_ERR("Advertising failed to start (err %d)", err);
 			return;
 		}
 
-		printk("Regular advertising started\n");
+		LOG_INF("Regular advertising started");
+		adv_phase_begin(ADV_PROFILE_PAIRING);
 	}
 
 	is_adv_running = true;
+	boot_profile_mark(BOOT_STAGE_ADV);
+}
+
+/* End of a phase: step down to the slow interval, or stop altogether */
+static void adv_phase_timeout(struct k_work *work)
+{
+	if (!is_adv_running || !adv_sched.timed) {
+		return;
+	}
+
+	if (adv_stop()) {
+		return;
+	}
+
+	if (adv_sched.phase == ADV_PHASE_FAST && adv_profiles[adv_sched.profile].slow_ms) {
+		LOG_INF("Advertising stepped down to the slow interval");
+		adv_sched.phase = ADV_PHASE_SLOW;
+#if CONFIG_SCROLL_RECONNECT_ACCEPT_LIST
+		reconnect_requested = (adv_sched.profile == ADV_PROFILE_RECONNECT);
+#endif
+		advertising_continue();
+		return;
+	}
+
+	adv_sched.phase = ADV_PHASE_STOPPED;
+	adv_stats.timeouts++;
+	LOG_INF("Advertising stopped, move the wheel or press the button to resume");
+
+	/* With no host connected the sensor thread watches for wheel motion */
+	magnetometer_start();
+	shelf_arm();
 }
 
 void advertising_start(void)
 {
-#if CONFIG_BT_DIRECTED_ADVERTISING
+	k_work_cancel_delayable(&adv_phase_work);
+	shelf_disarm();
+	adv_sched.phase = ADV_PHASE_FAST;
+	adv_stats.sessions++;
+	adv_started_at = k_uptime_get();
+
+#if CONFIG_SCROLL_RECONNECT_ACCEPT_LIST
+	reconnect_requested = true;
+#elif CONFIG_BT_DIRECTED_ADVERTISING
 	k_msgq_purge(&bonds_queue);
-	bt_foreach_bond(BT_ID_DEFAULT, bond_find, NULL);
+	bt_foreach_bond(host_slot_active(), bond_find, NULL);
 #endif
 
 	k_work_submit(&adv_work);
 }
 
+void advertising_request_directed(void)
+{
+	/* Directed builds start every session with directed advertising anyway */
+#if CONFIG_SCROLL_RECONNECT_ACCEPT_LIST
+	directed_requested = true;
+#endif
+}
+
+bool advertising_is_stopped(void)
+{
+	return adv_sched.phase == ADV_PHASE_STOPPED && !is_adv_running;
+}
+
+void advertising_resume(void)
+{
+	if (!advertising_is_stopped()) {
+		return;
+	}
+
+	LOG_INF("Advertising resumed");
+	advertising_start();
+}
+
+void advertising_stats_get(struct adv_stats *stats)
+{
+	*stats = adv_stats;
+
+	/* Include the phase in progress */
+	if (adv_sched.timed) {
+		uint32_t elapsed = (uint32_t)(k_uptime_get() - adv_sched.phase_started_at);
+
+		if (adv_sched.phase == ADV_PHASE_SLOW) {
+			stats->slow_ms[adv_sched.profile] += elapsed;
+		} else {
+			stats->fast_ms[adv_sched.profile] += elapsed;
+		}
+	}
+}
+
 static void advertising_process(struct k_work *work)
 {
 	advertising_continue();
@@ -196,12 +536,22 @@ void insert_conn_object(struct bt_conn *conn)
 		if (!conn_mode[i].conn) {
 			conn_mode[i].conn = conn;
 			conn_mode[i].in_boot_mode = false;
+			conn_mode[i].connected_at = k_uptime_get();
+			conn_mode[i].first_report_sent = false;
+
+			LOG_INF("Connected %u ms after advertising started",
+				(uint32_t)(conn_mode[i].connected_at - adv_started_at));
 
+			/* Advertising ended with the connection */
+			k_work_cancel_delayable(&adv_phase_work);
+			shelf_disarm();
+			adv_time_account();
+			host_slot_connected(conn);
 			return;
 		}
 	}
 
-	printk("Connection object could not be inserted %p\n", conn);
+	LOG_ERR("Connection object could not be inserted %p", conn);
 }
 
 
@@ -221,15 +571,25 @@ bool is_conn_slot_free(void)
 static void security_changed(struct bt_conn *conn, bt_security_t level,
 			     enum bt_security_err err)
 {
-	char addr[BT_ADDR_LE_STR_LEN];
-
-	bt_addr_le_to_str(bt_conn_get_dst(conn), addr, sizeof(addr));
+	const bt_addr_le_t *addr = bt_conn_get_dst(conn);
 
 	if (!err) {
-		printk("Security changed: %s level %u\n", addr, level);
+		LOG_INF("Security changed: " ADDR_LE_FMT " level %u", ADDR_LE_ARGS(addr), level);
+
+#if CONFIG_SCROLL_HID_EATT
+		/* Hosts without EATT reject the request and stay on the unenhanced bearer */
+		if (bt_eatt_count(conn) == 0) {
+			int eatt_err = bt_eatt_connect(conn, HID_EATT_CHANNELS);
+
+			if (eatt_err) {
+				LOG_WRN("EATT connect failed (err %d), using the unenhanced bearer",
+					eatt_err);
+			}
+		}
+#endif
 	} else {
-		printk("Security failed: %s level %u err %d %s\n", addr, level, err,
-		       bt_security_err_to_str(err));
+		LOG_ERR("Security failed: " ADDR_LE_FMT " level %u err %d %s", ADDR_LE_ARGS(addr), level, err,
+			bt_security_err_to_str(err));
 	}
 }
 #endif
@@ -246,11 +606,9 @@ BT_CONN_CB_DEFINE(conn_callbacks) = {
 #if defined(CONFIG_BT_HIDS_SECURITY_ENABLED)
 static void auth_passkey_display(struct bt_conn *conn, unsigned int passkey)
 {
-	char addr[BT_ADDR_LE_STR_LEN];
-
-	bt_addr_le_to_str(bt_conn_get_dst(conn), addr, sizeof(addr));
+	const bt_addr_le_t *addr = bt_conn_get_dst(conn);
 
-	printk("Passkey for %s: %06u\n", addr, passkey);
+	LOG_INF("Passkey for " ADDR_LE_FMT ": %06u", ADDR_LE_ARGS(addr), passkey);
 }
 
 
@@ -265,7 +623,7 @@ static void auth_passkey_confirm(struct bt_conn *conn, unsigned int passkey)
 
 	err = k_msgq_put(&mitm_queue, &pairing_data, K_NO_WAIT);
 	if (err) {
-		printk("Pairing queue is full. Purge previous data.\n");
+		LOG_WRN("Pairing queue is full. Purge previous data.");
 	}
 
 	/* In the case of multiple pairing requests, trigger
@@ -282,27 +640,23 @@ static void auth_passkey_confirm(struct bt_conn *conn, unsigned int passkey)
 
 static void auth_cancel(struct bt_conn *conn)
 {
-	char addr[BT_ADDR_LE_STR_LEN];
-
-	bt_addr_le_to_str(bt_conn_get_dst(conn), addr, sizeof(addr));
+	const bt_addr_le_t *addr = bt_conn_get_dst(conn);
 
-	printk("Pairing cancelled: %s\n", addr);
+	LOG_WRN("Pairing cancelled: " ADDR_LE_FMT, ADDR_LE_ARGS(addr));
 }
 
 
 static void pairing_complete(struct bt_conn *conn, bool bonded)
 {
-	char addr[BT_ADDR_LE_STR_LEN];
+	const bt_addr_le_t *addr = bt_conn_get_dst(conn);
 
-	bt_addr_le_to_str(bt_conn_get_dst(conn), addr, sizeof(addr));
-
-	printk("Pairing completed: %s, bonded: %d\n", addr, bonded);
+	LOG_INF("Pairing completed: " ADDR_LE_FMT ", bonded: %d", ADDR_LE_ARGS(addr), bonded);
 }
 
 
 static void pairing_failed(struct bt_conn *conn, enum bt_security_err reason)
 {
-	char addr[BT_ADDR_LE_STR_LEN];
+	const bt_addr_le_t *addr = bt_conn_get_dst(conn);
 	struct pairing_data_mitm pairing_data;
 
 	if (k_msgq_peek(&mitm_queue, &pairing_data) != 0) {
@@ -314,10 +668,8 @@ static void pairing_failed(struct bt_conn *conn, enum bt_security_err reason)
 		k_msgq_get(&mitm_queue, &pairing_data, K_NO_WAIT);
 	}
 
-	bt_addr_le_to_str(bt_conn_get_dst(conn), addr, sizeof(addr));
-
-	printk("Pairing failed conn: %s, reason %d %s\n", addr, reason,
-	       bt_security_err_to_str(reason));
+	LOG_ERR("Pairing failed conn: " ADDR_LE_FMT ", reason %d %s", ADDR_LE_ARGS(addr), reason,
+		bt_security_err_to_str(reason));
 }
 
 static struct bt_conn_auth_cb conn_auth_callbacks = {
@@ -349,10 +701,10 @@ static void num_comp_reply(bool accept)
 
 	if (accept) {
 		bt_conn_auth_passkey_confirm(conn);
-		printk("Numeric Match, conn %p\n", conn);
+		LOG_INF("Numeric Match, conn %p", conn);
 	} else {
 		bt_conn_auth_cancel(conn);
-		printk("Numeric Reject, conn %p\n", conn);
+		LOG_WRN("Numeric Reject, conn %p", conn);
 	}
 
 	bt_conn_unref(pairing_data.conn);
@@ -367,13 +719,13 @@ void register_auth_callbacks(void)
     int err;
     err = bt_conn_auth_cb_register(&conn_auth_callbacks);
     if (err) {
-        printk("Failed to register authorization callbacks.\n");
+        LOG_ERR("Failed to register authorization callbacks.");
         return;
     }
 
     err = bt_conn_auth_info_cb_register(&conn_auth_info_callbacks);
     if (err) {
-        printk("Failed to register authorization info callbacks.\n");
+        LOG_ERR("Failed to register authorization info callbacks.");
         return;
     }
 }
@@ -381,6 +733,7 @@ void register_auth_callbacks(void)
 void register_pairing_work(void)
 {
     k_work_init(&adv_work, advertising_process);
+	k_work_init_delayable(&adv_phase_work, adv_phase_timeout);
 	if (IS_ENABLED(CONFIG_BT_HIDS_SECURITY_ENABLED)) {
 		k_work_init(&pairing_work, pairing_process);
 	}
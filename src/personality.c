@@ -0,0 +1,102 @@
+#include <zephyr/kernel.h>
+#include <zephyr/settings/settings.h>
+#include <zephyr/shell/shell.h>
+#include <zephyr/logging/log.h>
+#include <string.h>
+
+#include "personality.h"
+
+LOG_MODULE_REGISTER(personality, CONFIG_SCROLL_LOG_LEVEL);
+
+static const char *const personality_names[HID_PERSONALITY_COUNT] = {
+	[HID_PERSONALITY_WHEEL] = "wheel",
+	[HID_PERSONALITY_DIAL] = "dial",
+};
+
+static atomic_t personality = ATOMIC_INIT(HID_PERSONALITY_WHEEL);
+
+#if CONFIG_SETTINGS
+static int personality_settings_set(const char *name, size_t len,
+				    settings_read_cb read_cb, void *cb_arg)
+{
+	uint8_t value;
+	int rc;
+
+	if (!settings_name_steq(name, "personality", NULL)) {
+		return -ENOENT;
+	}
+
+	if (len != sizeof(value)) {
+		return -EINVAL;
+	}
+
+	rc = read_cb(cb_arg, &value, sizeof(value));
+	if (rc < 0) {
+		return rc;
+	}
+
+	if (value >= HID_PERSONALITY_COUNT) {
+		return -EINVAL;
+	}
+
+	atomic_set(&personality, value);
+
+	return 0;
+}
+
+SETTINGS_STATIC_HANDLER_DEFINE(personality, "hid", NULL, personality_settings_set, NULL, NULL);
+#endif
+
+enum hid_personality hid_personality_get(void)
+{
+	return atomic_get(&personality);
+}
+
+int hid_personality_set(enum hid_personality new_personality)
+{
+	if (new_personality >= HID_PERSONALITY_COUNT) {
+		return -EINVAL;
+	}
+
+	if (atomic_set(&personality, new_personality) == new_personality) {
+		return 0;
+	}
+
+	LOG_INF("HID personality: %s", personality_names[new_personality]);
+
+#if CONFIG_SETTINGS
+	uint8_t value = new_personality;
+
+	settings_save_one("hid/personality", &value, sizeof(value));
+#endif
+
+	return 0;
+}
+
+#if CONFIG_SHELL
+static int cmd_hid_personality(const struct shell *sh, size_t argc, char **argv)
+{
+	if (argc < 2) {
+		shell_print(sh, "%s", personality_names[hid_personality_get()]);
+		return 0;
+	}
+
+	for (size_t i = 0; i < HID_PERSONALITY_COUNT; i++) {
+		if (strcmp(argv[1], personality_names[i]) == 0) {
+			return hid_personality_set(i);
+		}
+	}
+
+	shell_error(sh, "Unknown personality %s", argv[1]);
+
+	return -EINVAL;
+}
+
+SHELL_STATIC_SUBCMD_SET_CREATE(hid_cmds,
+	SHELL_CMD_ARG(personality, NULL, "Show or switch the HID personality [wheel|dial]",
+		      cmd_hid_personality, 1, 1),
+	SHELL_SUBCMD_SET_END
+);
+
+SHELL_CMD_REGISTER(hid, &hid_cmds, "HID report format", NULL);
+#endif /* CONFIG_SHELL */
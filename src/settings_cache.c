@@ -0,0 +1,312 @@
+#include <zephyr/kernel.h>
+#include <zephyr/settings/settings.h>
+#include <zephyr/logging/log.h>
+#include <string.h>
+
+/*
+ * The settings subsystem has no API to put a store in front of the one
+ * registered as the save destination, the cache takes settings_save_dst
+ * from the subsystem's private header instead. cmake/settings_cache.cmake
+ * checks at configure time that the header still declares it.
+ */
+#include "settings_priv.h"
+
+#include "settings_cache.h"
+#include "scroll.h"
+
+LOG_MODULE_REGISTER(settings_cache, CONFIG_SCROLL_LOG_LEVEL);
+
+/* Longest record name kept in the cache, longer ones are written through */
+#define CACHE_NAME_MAX 32
+
+/*
+ * Records the host stack rewrites on every reconnection and subscription
+ * change. They are held in RAM and written once scrolling has paused.
+ * Everything else under "bt/", bond keys above all, is still written at
+ * once when it changes: a new key lost to a flat battery would leave the
+ * host with a bond the device no longer has.
+ */
+static const char *const deferred_prefixes[] = {
+	"bt/ccc",
+	"bt/cf",
+	"bt/hash",
+	"bt/sc",
+};
+
+struct cache_entry {
+	char name[CACHE_NAME_MAX + 1];	/* empty if the entry is free */
+	bool present;			/* false once deleted or never stored */
+	bool dirty;			/* differs from storage, waiting for a flush */
+	uint16_t len;
+	uint8_t value[CONFIG_SCROLL_SETTINGS_CACHE_VALUE_MAX];
+};
+
+static struct cache_entry entries[CONFIG_SCROLL_SETTINGS_CACHE_ENTRIES];
+static struct settings_store *backing;
+static struct settings_cache_stats cache_stats;
+static K_MUTEX_DEFINE(cache_lock);
+static K_MUTEX_DEFINE(flush_lock);
+static k_tid_t flush_thread;
+static struct k_work_delayable flush_work;
+
+static int backing_save(const char *name, const char *value, size_t val_len)
+{
+	int err = backing->cs_itf->csi_save(backing, name, value, val_len);
+
+	/* Called without the cache lock, the backend may take a while */
+	if (!err) {
+		k_mutex_lock(&cache_lock, K_FOREVER);
+		cache_stats.flash_writes++;
+		k_mutex_unlock(&cache_lock);
+	}
+
+	return err;
+}
+
+static bool record_deferred(const char *name)
+{
+	for (size_t i = 0; i < ARRAY_SIZE(deferred_prefixes); i++) {
+		if (strncmp(name, deferred_prefixes[i], strlen(deferred_prefixes[i])) == 0) {
+			return true;
+		}
+	}
+
+	return false;
+}
+
+static int entry_load_cb(const char *key, size_t len, settings_read_cb read_cb,
+			 void *cb_arg, void *param)
+{
+	struct cache_entry *entry = param;
+	ssize_t rc;
+
+	/* Only the record itself, not the ones below it */
+	if (key != NULL) {
+		return 0;
+	}
+
+	/* A stored value that does not fit can never match, so it is treated as absent */
+	if (len == 0 || len > sizeof(entry->value)) {
+		entry->present = false;
+		return 0;
+	}
+
+	rc = read_cb(cb_arg, entry->value, len);
+	entry->present = (rc == len);
+	entry->len = entry->present ? len : 0;
+
+	return 0;
+}
+
+/* Find the record's entry, or take a free one and fill it from storage */
+static struct cache_entry *entry_get(const char *name)
+{
+	struct cache_entry *free_entry = NULL;
+
+	for (size_t i = 0; i < ARRAY_SIZE(entries); i++) {
+		if (entries[i].name[0] == '\0') {
+			free_entry = free_entry ? free_entry : &entries[i];
+		} else if (strcmp(entries[i].name, name) == 0) {
+			return &entries[i];
+		}
+	}
+
+	if (free_entry == NULL || strlen(name) > CACHE_NAME_MAX) {
+		return NULL;
+	}
+
+	memset(free_entry, 0, sizeof(*free_entry));
+	strcpy(free_entry->name, name);
+	settings_load_subtree_direct(name, entry_load_cb, free_entry);
+
+	return free_entry;
+}
+
+static bool entry_matches(const struct cache_entry *entry, const char *value, size_t val_len)
+{
+	if (value == NULL || val_len == 0) {
+		return !entry->present;
+	}
+
+	return entry->present && entry->len == val_len && memcmp(entry->value, value, val_len) == 0;
+}
+
+static void entry_free(struct cache_entry *entry)
+{
+	if (entry->dirty) {
+		cache_stats.dirty--;
+	}
+	entry->name[0] = '\0';
+	entry->dirty = false;
+}
+
+static int cache_save(struct settings_store *cs, const char *name,
+		      const char *value, size_t val_len)
+{
+	struct cache_entry *entry;
+
+	/* The flush itself, and records outside the host stack's */
+	if (k_current_get() == flush_thread || strncmp(name, "bt/", 3) != 0) {
+		return backing_save(name, value, val_len);
+	}
+
+	k_mutex_lock(&cache_lock, K_FOREVER);
+
+	entry = entry_get(name);
+	if (entry == NULL || val_len > sizeof(entry->value)) {
+		if (entry != NULL) {
+			entry_free(entry);
+		}
+		cache_stats.uncached++;
+		k_mutex_unlock(&cache_lock);
+		return backing_save(name, value, val_len);
+	}
+
+	if (entry_matches(entry, value, val_len)) {
+		cache_stats.skipped++;
+		k_mutex_unlock(&cache_lock);
+		return 0;
+	}
+
+	entry->present = (value != NULL && val_len > 0);
+	entry->len = entry->present ? val_len : 0;
+	if (entry->present) {
+		memcpy(entry->value, value, val_len);
+	}
+
+	if (record_deferred(name)) {
+		if (!entry->dirty) {
+			entry->dirty = true;
+			cache_stats.dirty++;
+		}
+		cache_stats.deferred++;
+		k_work_reschedule(&flush_work, K_MSEC(CONFIG_SCROLL_SETTINGS_CACHE_IDLE_MS));
+		k_mutex_unlock(&cache_lock);
+		return 0;
+	}
+
+	/* Written through: the entry now mirrors storage, unless the write failed */
+	if (entry->dirty) {
+		entry->dirty = false;
+		cache_stats.dirty--;
+	}
+	k_mutex_unlock(&cache_lock);
+
+	int err = backing_save(name, value, val_len);
+
+	if (err) {
+		k_mutex_lock(&cache_lock, K_FOREVER);
+		entry_free(entry);
+		k_mutex_unlock(&cache_lock);
+	}
+
+	return err;
+}
+
+static int cache_save_start(struct settings_store *cs)
+{
+	if (backing->cs_itf->csi_save_start) {
+		return backing->cs_itf->csi_save_start(backing);
+	}
+
+	return 0;
+}
+
+static int cache_save_end(struct settings_store *cs)
+{
+	if (backing->cs_itf->csi_save_end) {
+		return backing->cs_itf->csi_save_end(backing);
+	}
+
+	return 0;
+}
+
+static const struct settings_store_itf cache_itf = {
+	.csi_save_start = cache_save_start,
+	.csi_save = cache_save,
+	.csi_save_end = cache_save_end,
+};
+
+static struct settings_store cache_store = {
+	.cs_itf = &cache_itf,
+};
+
+void settings_cache_flush(void)
+{
+	/* Static: entries are too large for the caller's stack */
+	static struct cache_entry record;
+	uint32_t written = 0;
+
+	k_mutex_lock(&flush_lock, K_FOREVER);
+	flush_thread = k_current_get();
+
+	for (size_t i = 0; i < ARRAY_SIZE(entries); i++) {
+		int err;
+
+		k_mutex_lock(&cache_lock, K_FOREVER);
+		if (!entries[i].dirty) {
+			k_mutex_unlock(&cache_lock);
+			continue;
+		}
+		record = entries[i];
+		entries[i].dirty = false;
+		cache_stats.dirty--;
+		k_mutex_unlock(&cache_lock);
+
+		if (record.present) {
+			err = settings_save_one(record.name, record.value, record.len);
+		} else {
+			err = settings_delete(record.name);
+		}
+
+		if (err) {
+			LOG_WRN("Cannot store %s (err %d)", record.name, err);
+			continue;
+		}
+		written++;
+	}
+
+	flush_thread = NULL;
+	k_mutex_unlock(&flush_lock);
+
+	if (written > 0) {
+		k_mutex_lock(&cache_lock, K_FOREVER);
+		cache_stats.flushes++;
+		k_mutex_unlock(&cache_lock);
+		LOG_DBG("Flushed %u records", written);
+	}
+}
+
+/* Wait for a pause in scrolling, the flash controller stalls the CPU while it writes */
+static void flush_handler(struct k_work *work)
+{
+	int64_t idle_ms = k_uptime_get() - scroll_activity_at;
+
+	if (idle_ms < CONFIG_SCROLL_SETTINGS_CACHE_IDLE_MS) {
+		k_work_reschedule(&flush_work, K_MSEC(CONFIG_SCROLL_SETTINGS_CACHE_IDLE_MS - idle_ms));
+		return;
+	}
+
+	settings_cache_flush();
+}
+
+/* settings_save_dst is the storage backend registered by settings_subsys_init() */
+int settings_cache_init(void)
+{
+	if (settings_save_dst == NULL || settings_save_dst == &cache_store) {
+		return -ENODEV;
+	}
+
+	k_work_init_delayable(&flush_work, flush_handler);
+	backing = settings_save_dst;
+	settings_dst_register(&cache_store);
+
+	return 0;
+}
+
+void settings_cache_stats_get(struct settings_cache_stats *stats)
+{
+	k_mutex_lock(&cache_lock, K_FOREVER);
+	*stats = cache_stats;
+	k_mutex_unlock(&cache_lock);
+}
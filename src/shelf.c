@@ -0,0 +1,168 @@
+#include <zephyr/kernel.h>
+#include <zephyr/devicetree.h>
+#include <zephyr/drivers/gpio.h>
+#include <zephyr/sys/poweroff.h>
+#include <zephyr/retention/retention.h>
+#include <zephyr/logging/log.h>
+#include <soc.h>
+#include <string.h>
+
+#include "shelf.h"
+#include "scroll.h"
+#include "pairing.h"
+#include "settings_cache.h"
+#include "charger.h"
+
+LOG_MODULE_REGISTER(shelf, CONFIG_SCROLL_LOG_LEVEL);
+
+/* RAM block that MCUboot and the application both leave alone, see the board overlay */
+#define SHELF_RAM DT_NODELABEL(shelf_ram)
+
+/*
+ * State that survives System OFF. Kept here and written through to the
+ * retention area, which adds the prefix and checksum checked on wake.
+ */
+struct shelf_retained {
+	uint8_t slot;
+	uint8_t battery_level;
+	uint16_t reserved;
+	uint32_t entries;	/* times the device went to the shelf */
+};
+
+static const struct device *const retention = DEVICE_DT_GET(DT_NODELABEL(shelf_retention));
+static struct shelf_retained retained;
+static bool woke;
+
+static const struct gpio_dt_spec wake_button = GPIO_DT_SPEC_GET(DT_PATH(buttons, button), gpios);
+
+/* Output levels hold through System OFF, so the LEDs are let go first */
+static const struct gpio_dt_spec leds[] = {
+	GPIO_DT_SPEC_GET(DT_ALIAS(led0), gpios),
+	GPIO_DT_SPEC_GET(DT_ALIAS(led1), gpios),
+	GPIO_DT_SPEC_GET(DT_ALIAS(led2), gpios),
+};
+
+static struct k_work_delayable shelf_work;
+
+static void retained_update(void)
+{
+	int err = retention_write(retention, 0, (const uint8_t *)&retained, sizeof(retained));
+
+	if (err) {
+		LOG_ERR("Cannot write retained state (err %d)", err);
+	}
+}
+
+/*
+ * System OFF powers RAM down unless the section is marked for retention.
+ * nRF52 RAM0-7 have two 4 KB sections each, RAM8 has 32 KB sections.
+ */
+static void ram_section_retain(uintptr_t addr)
+{
+	uint32_t offset = addr - DT_REG_ADDR(DT_CHOSEN(zephyr_sram));
+	uint32_t block;
+	uint32_t section;
+
+	if (offset < KB(64)) {
+		block = offset / KB(8);
+		section = (offset / KB(4)) % 2;
+	} else {
+		block = 8;
+		section = (offset - KB(64)) / KB(32);
+	}
+
+	NRF_POWER->RAM[block].POWERSET = BIT(POWER_RAM_POWERSET_S0RETENTION_Pos + section);
+}
+
+static void shelf_enter(struct k_work *work)
+{
+	if (bt_connected || !advertising_is_stopped()) {
+		return;
+	}
+
+	/* Nothing to save on USB power, and the charger keeps running */
+	if (charger_state_get() != CHARGER_BATTERY) {
+		shelf_arm();
+		return;
+	}
+
+	retained.entries++;
+	retained_update();
+	ram_section_retain(DT_REG_ADDR(SHELF_RAM));
+	ram_section_retain(DT_REG_ADDR(SHELF_RAM) + DT_REG_SIZE(SHELF_RAM) - 1);
+
+	for (size_t i = 0; i < ARRAY_SIZE(leds); i++) {
+		gpio_pin_configure_dt(&leds[i], GPIO_DISCONNECTED);
+	}
+
+	/* The pin's SENSE level brings the chip out of System OFF through a reset */
+	gpio_pin_configure_dt(&wake_button, GPIO_INPUT);
+	gpio_pin_interrupt_configure_dt(&wake_button, GPIO_INT_LEVEL_ACTIVE);
+
+	LOG_INF("No host for %u min, entering System OFF, press the button to wake",
+		CONFIG_SCROLL_SHELF_TIMEOUT_MIN);
+	settings_cache_flush();
+	LOG_PANIC();
+
+	sys_poweroff();
+}
+
+void shelf_init(void)
+{
+	uint32_t reason = NRF_POWER->RESETREAS;
+
+	/* Reset reasons accumulate until cleared */
+	NRF_POWER->RESETREAS = reason;
+
+	woke = (reason & POWER_RESETREAS_OFF_Msk) && device_is_ready(retention) &&
+	       retention_is_valid(retention) == 1 &&
+	       retention_read(retention, 0, (uint8_t *)&retained, sizeof(retained)) == 0;
+	if (!woke) {
+		memset(&retained, 0, sizeof(retained));
+		retained_update();
+	}
+
+	k_work_init_delayable(&shelf_work, shelf_enter);
+
+	if (woke) {
+		LOG_INF("Woke from System OFF (shelved %u times), slot %u, battery %u%%",
+			retained.entries, retained.slot + 1, retained.battery_level);
+	}
+}
+
+bool shelf_woke(void)
+{
+	return woke;
+}
+
+void shelf_arm(void)
+{
+	k_work_reschedule(&shelf_work, K_MINUTES(CONFIG_SCROLL_SHELF_TIMEOUT_MIN));
+}
+
+void shelf_disarm(void)
+{
+	k_work_cancel_delayable(&shelf_work);
+}
+
+void shelf_retain_slot(uint8_t slot)
+{
+	retained.slot = slot;
+	retained_update();
+}
+
+void shelf_retain_battery(uint8_t level)
+{
+	retained.battery_level = level;
+	retained_update();
+}
+
+uint8_t shelf_retained_slot(void)
+{
+	return retained.slot;
+}
+
+uint8_t shelf_retained_battery(void)
+{
+	return retained.battery_level;
+}
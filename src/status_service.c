@@ -0,0 +1,116 @@
+#include <zephyr/types.h>
+#include <stddef.h>
+#include <zephyr/kernel.h>
+#include <zephyr/bluetooth/bluetooth.h>
+#include <zephyr/bluetooth/conn.h>
+#include <zephyr/bluetooth/uuid.h>
+#include <zephyr/bluetooth/gatt.h>
+
+#include "status_service.h"
+#include "diagnostics.h"
+#include "personality.h"
+
+/* Vendor specific scroll wheel status service */
+#define BT_UUID_SCROLL_STATUS_VAL \
+	BT_UUID_128_ENCODE(0x5c7a0001, 0x3e1b, 0x4f6d, 0x9a2e, 0x6b1f0c8d2a40)
+#define BT_UUID_SCROLL_MAGNET_HEALTH_VAL \
+	BT_UUID_128_ENCODE(0x5c7a0002, 0x3e1b, 0x4f6d, 0x9a2e, 0x6b1f0c8d2a40)
+#define BT_UUID_SCROLL_DIAGNOSTICS_VAL \
+	BT_UUID_128_ENCODE(0x5c7a0003, 0x3e1b, 0x4f6d, 0x9a2e, 0x6b1f0c8d2a40)
+#define BT_UUID_SCROLL_PERSONALITY_VAL \
+	BT_UUID_128_ENCODE(0x5c7a0004, 0x3e1b, 0x4f6d, 0x9a2e, 0x6b1f0c8d2a40)
+
+#if CONFIG_BT_HIDS_SECURITY_ENABLED
+#define STATUS_PERM_READ  BT_GATT_PERM_READ_ENCRYPT
+#define STATUS_PERM_RW    (BT_GATT_PERM_READ_ENCRYPT | BT_GATT_PERM_WRITE_ENCRYPT)
+#else
+#define STATUS_PERM_READ  BT_GATT_PERM_READ
+#define STATUS_PERM_RW    (BT_GATT_PERM_READ | BT_GATT_PERM_WRITE)
+#endif
+
+static struct bt_uuid_128 status_svc_uuid = BT_UUID_INIT_128(BT_UUID_SCROLL_STATUS_VAL);
+static struct bt_uuid_128 magnet_health_uuid = BT_UUID_INIT_128(BT_UUID_SCROLL_MAGNET_HEALTH_VAL);
+
+static struct magnet_health magnet_health_value;
+
+static ssize_t read_magnet_health(struct bt_conn *conn, const struct bt_gatt_attr *attr,
+				  void *buf, uint16_t len, uint16_t offset)
+{
+	return bt_gatt_attr_read(conn, attr, buf, len, offset,
+				 &magnet_health_value, sizeof(magnet_health_value));
+}
+
+#if CONFIG_SCROLL_DIAGNOSTICS
+static struct bt_uuid_128 diagnostics_uuid = BT_UUID_INIT_128(BT_UUID_SCROLL_DIAGNOSTICS_VAL);
+
+static ssize_t read_diagnostics(struct bt_conn *conn, const struct bt_gatt_attr *attr,
+				void *buf, uint16_t len, uint16_t offset)
+{
+	struct diag_summary summary;
+
+	diagnostics_summary_get(&summary);
+
+	return bt_gatt_attr_read(conn, attr, buf, len, offset, &summary, sizeof(summary));
+}
+#endif
+
+#if CONFIG_SCROLL_DIAL
+static struct bt_uuid_128 personality_uuid = BT_UUID_INIT_128(BT_UUID_SCROLL_PERSONALITY_VAL);
+
+/* One byte, enum hid_personality */
+static ssize_t read_personality(struct bt_conn *conn, const struct bt_gatt_attr *attr,
+				void *buf, uint16_t len, uint16_t offset)
+{
+	uint8_t value = hid_personality_get();
+
+	return bt_gatt_attr_read(conn, attr, buf, len, offset, &value, sizeof(value));
+}
+
+static ssize_t write_personality(struct bt_conn *conn, const struct bt_gatt_attr *attr,
+				 const void *buf, uint16_t len, uint16_t offset, uint8_t flags)
+{
+	if (offset != 0) {
+		return BT_GATT_ERR(BT_ATT_ERR_INVALID_OFFSET);
+	}
+
+	if (len != sizeof(uint8_t)) {
+		return BT_GATT_ERR(BT_ATT_ERR_INVALID_ATTRIBUTE_LEN);
+	}
+
+	if (hid_personality_set(*(const uint8_t *)buf) != 0) {
+		return BT_GATT_ERR(BT_ATT_ERR_VALUE_NOT_ALLOWED);
+	}
+
+	return len;
+}
+#endif
+
+BT_GATT_SERVICE_DEFINE(status_svc,
+	BT_GATT_PRIMARY_SERVICE(&status_svc_uuid),
+	BT_GATT_CHARACTERISTIC(&magnet_health_uuid.uuid,
+			       BT_GATT_CHRC_READ | BT_GATT_CHRC_NOTIFY,
+			       STATUS_PERM_READ, read_magnet_health, NULL, NULL),
+	BT_GATT_CCC(NULL, STATUS_PERM_RW),
+	IF_ENABLED(CONFIG_SCROLL_DIAGNOSTICS, (
+	BT_GATT_CHARACTERISTIC(&diagnostics_uuid.uuid, BT_GATT_CHRC_READ,
+			       STATUS_PERM_READ, read_diagnostics, NULL, NULL),
+	))
+	IF_ENABLED(CONFIG_SCROLL_DIAL, (
+	BT_GATT_CHARACTERISTIC(&personality_uuid.uuid,
+			       BT_GATT_CHRC_READ | BT_GATT_CHRC_WRITE,
+			       STATUS_PERM_RW, read_personality, write_personality, NULL),
+	))
+);
+
+void status_service_magnet_update(const struct magnet_health *health)
+{
+	bool status_changed = (health->status != magnet_health_value.status);
+
+	magnet_health_value = *health;
+
+	if (status_changed) {
+		/* -ENOTCONN only means nobody is subscribed */
+		bt_gatt_notify(NULL, &status_svc.attrs[1],
+			       &magnet_health_value, sizeof(magnet_health_value));
+	}
+}
@@ -0,0 +1,212 @@
+#include <zephyr/kernel.h>
+#include <zephyr/init.h>
+#include <zephyr/bluetooth/bluetooth.h>
+#include <zephyr/bluetooth/conn.h>
+#include <zephyr/logging/log.h>
+#if CONFIG_BT_RADIO_NOTIFICATION_CONN_CB
+#include <bluetooth/radio_notification_cb.h>
+#endif
+
+#include "wake_sync.h"
+#include "magnetometer.h"
+
+LOG_MODULE_REGISTER(wake_sync, CONFIG_SCROLL_LOG_LEVEL);
+
+/*
+ * Every link's connection events wake the radio and the CPU, and the sensor
+ * timer is one more wake source. The other hosts are asked for the lead
+ * host's interval, so all links wake at the same rate, and the sensor is
+ * sampled right before the lead host's events instead of on its own timer.
+ * Anchor points are the centrals' choice: a peripheral can match the
+ * intervals, not line up the events.
+ */
+
+struct sync_link {
+	uint32_t requested_us;	/* interval last asked of this host, 0 if none */
+};
+
+static struct sync_link links[CONFIG_BT_MAX_CONN];
+static struct k_work match_work;
+static struct wake_sync_stats wake_stats;
+static int64_t stats_reset_at;
+static uint32_t samples_at_reset;
+static atomic_t radio_events;
+static atomic_t aligned_samples;
+static atomic_t lead_index = ATOMIC_INIT(-1);
+
+struct link_scan {
+	int lead;			/* lowest connection index, the lead host */
+	struct bt_conn_info lead_info;
+	uint8_t links;
+	uint8_t matched;
+};
+
+static void link_scan(struct bt_conn *conn, void *data)
+{
+	struct link_scan *scan = data;
+	struct bt_conn_info info;
+
+	if (bt_conn_get_info(conn, &info) || info.state != BT_CONN_STATE_CONNECTED) {
+		return;
+	}
+
+	scan->links++;
+	if (scan->lead < 0 || bt_conn_index(conn) < scan->lead) {
+		scan->lead = bt_conn_index(conn);
+		scan->lead_info = info;
+	}
+}
+
+static void link_match(struct bt_conn *conn, void *data)
+{
+	struct link_scan *scan = data;
+	struct sync_link *link = &links[bt_conn_index(conn)];
+	uint16_t interval = scan->lead_info.le.interval;
+	struct bt_conn_info info;
+	int err;
+
+	if (bt_conn_get_info(conn, &info) || info.state != BT_CONN_STATE_CONNECTED) {
+		return;
+	}
+
+	if (info.le.interval == interval) {
+		scan->matched++;
+		return;
+	}
+
+	/* Once per lead interval: a host that refuses is not asked again and again */
+	if (bt_conn_index(conn) == scan->lead ||
+	    link->requested_us == BT_CONN_INTERVAL_TO_US(interval)) {
+		return;
+	}
+	link->requested_us = BT_CONN_INTERVAL_TO_US(interval);
+
+	/* The host's own latency and timeout stay */
+	err = bt_conn_le_param_update(conn, BT_LE_CONN_PARAM(interval, interval, info.le.latency,
+							     info.le.timeout));
+	if (err) {
+		LOG_WRN("Interval match request failed (err %d)", err);
+		return;
+	}
+
+	wake_stats.match_requests++;
+	LOG_DBG("Asked host %u for %u us", bt_conn_index(conn), BT_CONN_INTERVAL_TO_US(interval));
+}
+
+static void match_handler(struct k_work *work)
+{
+	struct link_scan scan = {.lead = -1};
+
+	bt_conn_foreach(BT_CONN_TYPE_LE, link_scan, &scan);
+	atomic_set(&lead_index, scan.lead);
+
+	wake_stats.links = scan.links;
+	if (scan.lead < 0) {
+		wake_stats.lead_interval_us = 0;
+		wake_stats.matched_links = 0;
+		return;
+	}
+
+	bt_conn_foreach(BT_CONN_TYPE_LE, link_match, &scan);
+	wake_stats.lead_interval_us = BT_CONN_INTERVAL_TO_US(scan.lead_info.le.interval);
+	wake_stats.matched_links = scan.matched;
+}
+
+#if CONFIG_BT_RADIO_NOTIFICATION_CONN_CB
+/* Runs CONFIG_SCROLL_WAKE_SYNC_LEAD_US ahead of every connection event */
+static void radio_prepare(struct bt_conn *conn)
+{
+	struct bt_conn_info info;
+
+	atomic_inc(&radio_events);
+
+	if (bt_conn_index(conn) != atomic_get(&lead_index) || bt_conn_get_info(conn, &info)) {
+		return;
+	}
+
+	if (magnetometer_sync(BT_CONN_INTERVAL_TO_US(info.le.interval))) {
+		atomic_inc(&aligned_samples);
+	}
+}
+
+static const struct bt_radio_notification_conn_cb radio_cb = {
+	.prepare = radio_prepare,
+};
+#endif
+
+static void connected(struct bt_conn *conn, uint8_t err)
+{
+	if (err) {
+		return;
+	}
+
+	links[bt_conn_index(conn)].requested_us = 0;
+	k_work_submit(&match_work);
+}
+
+static void disconnected(struct bt_conn *conn, uint8_t reason)
+{
+	/* Sampling falls back to its own timer until the next lead reports in */
+	if (bt_conn_index(conn) == atomic_get(&lead_index)) {
+		atomic_set(&lead_index, -1);
+		magnetometer_sync(0);
+	}
+
+	k_work_submit(&match_work);
+}
+
+static void le_param_updated(struct bt_conn *conn, uint16_t interval, uint16_t latency,
+			     uint16_t timeout)
+{
+	k_work_submit(&match_work);
+}
+
+BT_CONN_CB_DEFINE(wake_sync_conn_callbacks) = {
+	.connected = connected,
+	.disconnected = disconnected,
+	.le_param_updated = le_param_updated,
+};
+
+void wake_sync_stats_get(struct wake_sync_stats *stats)
+{
+	struct sample_timing timing;
+
+	magnetometer_timing_get(&timing);
+
+	*stats = wake_stats;
+	stats->elapsed_ms = (uint32_t)(k_uptime_get() - stats_reset_at);
+	stats->radio_events = atomic_get(&radio_events);
+	stats->aligned_samples = atomic_get(&aligned_samples);
+	stats->sensor_samples = timing.samples - samples_at_reset;
+}
+
+void wake_sync_stats_reset(void)
+{
+	struct sample_timing timing;
+
+	magnetometer_timing_get(&timing);
+
+	samples_at_reset = timing.samples;
+	stats_reset_at = k_uptime_get();
+	wake_stats.match_requests = 0;
+	atomic_clear(&radio_events);
+	atomic_clear(&aligned_samples);
+}
+
+static int wake_sync_init(void)
+{
+	k_work_init(&match_work, match_handler);
+
+#if CONFIG_BT_RADIO_NOTIFICATION_CONN_CB
+	int err = bt_radio_notification_conn_cb_register(&radio_cb, CONFIG_SCROLL_WAKE_SYNC_LEAD_US);
+
+	if (err) {
+		LOG_ERR("Cannot register radio notifications (err %d)", err);
+		return err;
+	}
+#endif
+
+	return 0;
+}
+
+SYS_INIT(wake_sync_init, APPLICATION, CONFIG_APPLICATION_INIT_PRIORITY);
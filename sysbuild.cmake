@@ -0,0 +1,13 @@
+#
+# SPDX-License-Identifier: LicenseRef-Nordic-5-Clause
+#
+
+# MCUboot runs from the same RAM before the application. On boards that
+# keep state in retained RAM it is built without that block as well.
+string(REPLACE "/" "_" board_target "${BOARD}${BOARD_QUALIFIERS}")
+set(mcuboot_retained_overlay ${CMAKE_CURRENT_LIST_DIR}/sysbuild/mcuboot_${board_target}.overlay)
+
+if(SB_CONFIG_BOOTLOADER_MCUBOOT AND EXISTS ${mcuboot_retained_overlay})
+  list(APPEND mcuboot_EXTRA_DTC_OVERLAY_FILE ${mcuboot_retained_overlay})
+  set(mcuboot_EXTRA_DTC_OVERLAY_FILE ${mcuboot_EXTRA_DTC_OVERLAY_FILE} CACHE INTERNAL "")
+endif()
@@ -0,0 +1,194 @@
+/*
+ * AS5600 driver retry, bus recovery and backoff against the emulator's
+ * fault injection. A fault covers a number of bus transfers, the tests
+ * fetch once per active sample period as the wheel does and check that
+ * the wheel is back within one maximum backoff of the bus recovering.
+ */
+#include <zephyr/ztest.h>
+#include <zephyr/drivers/emul.h>
+#include <zephyr/drivers/sensor.h>
+
+#include "custom_as5600.h"
+#include "custom_as5600_emul.h"
+#include "scroll.h"
+
+#define WHEEL_NODE DT_NODELABEL(wheel)
+
+/* Transfers a fetch uses before giving up: first attempt, retries, CONF write of the recovery */
+#define FAILED_FETCH_TRANSFERS (CONFIG_CUSTOM_AS5600_RETRIES + 2)
+/* Enough failed fetches to double the backoff up to its maximum */
+#define LONG_FAULT_TRANSFERS (8 * FAILED_FETCH_TRANSFERS)
+/*
+ * Failed sample periods allowed once the fault has run out: the one whose
+ * fetch used it up, then at most one maximum backoff
+ */
+#define RECOVERY_PERIODS_MAX \
+	(1 + DIV_ROUND_UP(CONFIG_CUSTOM_AS5600_BACKOFF_MAX_MS, ACTIVE_MODE_PERIOD_MS))
+/* Give up on a fault that never ends */
+#define FETCH_PERIODS_MAX 1000
+
+static const struct device *const wheel = DEVICE_DT_GET(WHEEL_NODE);
+static const struct emul *const wheel_emul = EMUL_DT_GET(WHEEL_NODE);
+
+/* Counters at the start of a test */
+static struct as5600_stats stats_before;
+
+static void stats_get(struct as5600_stats *stats)
+{
+	zassert_ok(as5600_stats_get(wheel, stats));
+}
+
+static void attr_set(enum as5600_attributes attr, int32_t value)
+{
+	struct sensor_value val = { .val1 = value };
+
+	zassert_ok(sensor_attr_set(wheel, SENSOR_CHAN_ROTATION, (enum sensor_attribute)attr, &val));
+}
+
+/*
+ * Fetch once per sample period until a fetch succeeds. Returns the number
+ * of failed periods since the fault's transfers had all been NACKed.
+ */
+static uint32_t fetch_until_ok(uint32_t fault_transfers)
+{
+	const uint32_t nacked_before = as5600_emul_nacked_transfers(wheel_emul);
+	uint32_t failed_after_fault = 0;
+
+	for (uint32_t period = 0; period < FETCH_PERIODS_MAX; period++) {
+		int err = sensor_sample_fetch_chan(wheel, SENSOR_CHAN_ROTATION);
+		bool fault_over =
+			as5600_emul_nacked_transfers(wheel_emul) - nacked_before >= fault_transfers;
+
+		if (err == 0) {
+			zassert_true(fault_over, "fetch succeeded while the bus was still failing");
+			return failed_after_fault;
+		}
+		zassert_true(err == -EIO || err == -EAGAIN, "fetch failed with %d", err);
+
+		if (fault_over) {
+			failed_after_fault++;
+		}
+		k_sleep(K_MSEC(ACTIVE_MODE_PERIOD_MS));
+	}
+
+	zassert_unreachable("no successful fetch in %u periods", FETCH_PERIODS_MAX);
+
+	return UINT32_MAX;
+}
+
+ZTEST(as5600_recovery, test_nack_retried)
+{
+	struct as5600_stats stats;
+
+	/* A glitch the fast retries cover, the sample is not lost */
+	as5600_emul_inject_fault(wheel_emul, AS5600_EMUL_FAULT_NACK, CONFIG_CUSTOM_AS5600_RETRIES);
+	zassert_ok(sensor_sample_fetch_chan(wheel, SENSOR_CHAN_ROTATION));
+
+	stats_get(&stats);
+	zassert_equal(stats.i2c_errors - stats_before.i2c_errors, CONFIG_CUSTOM_AS5600_RETRIES);
+	zassert_equal(stats.retries - stats_before.retries, 1);
+	zassert_equal(stats.bus_recoveries, stats_before.bus_recoveries, "bus recovered");
+	zassert_equal(stats.conf_restores, stats_before.conf_restores, "CONF written");
+}
+
+ZTEST(as5600_recovery, test_nack_bus_recovery)
+{
+	struct as5600_stats stats;
+	uint16_t conf = as5600_emul_get_conf(wheel_emul);
+
+	/* One NACK past the retries: the bus is recovered and the same fetch succeeds */
+	as5600_emul_inject_fault(wheel_emul, AS5600_EMUL_FAULT_NACK,
+				 CONFIG_CUSTOM_AS5600_RETRIES + 1);
+	zassert_ok(sensor_sample_fetch_chan(wheel, SENSOR_CHAN_ROTATION));
+
+	stats_get(&stats);
+	zassert_equal(stats.bus_recoveries - stats_before.bus_recoveries, 1);
+	zassert_equal(stats.conf_restores - stats_before.conf_restores, 1);
+	zassert_equal(stats.recovery_failures, stats_before.recovery_failures);
+	zassert_equal(stats.retries - stats_before.retries, 1);
+	zassert_equal(as5600_emul_get_conf(wheel_emul), conf);
+}
+
+ZTEST(as5600_recovery, test_nack_backoff_bounded)
+{
+	struct as5600_stats stats;
+	uint32_t failed;
+
+	/* A hung bus: recoveries fail until the backoff is at its maximum */
+	as5600_emul_inject_fault(wheel_emul, AS5600_EMUL_FAULT_NACK, LONG_FAULT_TRANSFERS);
+	failed = fetch_until_ok(LONG_FAULT_TRANSFERS);
+	zassert_true(failed <= RECOVERY_PERIODS_MAX, "%u failed periods after the bus came back",
+		     failed);
+
+	stats_get(&stats);
+	zassert_true(stats.recovery_failures - stats_before.recovery_failures >=
+		     LONG_FAULT_TRANSFERS / FAILED_FETCH_TRANSFERS - 1);
+	zassert_true(stats.bus_recoveries - stats_before.bus_recoveries >=
+		     stats.recovery_failures - stats_before.recovery_failures);
+
+	/* Left pending by the failed recoveries, written once the bus is back */
+	zassert_equal(stats.conf_restores - stats_before.conf_restores, 1);
+}
+
+ZTEST(as5600_recovery, test_power_loss_restores_conf)
+{
+	struct as5600_stats stats;
+	uint16_t conf = as5600_emul_get_conf(wheel_emul);
+	uint32_t failed;
+
+	/* The sensor loses CONF and stays off the bus for longer than any recovery */
+	as5600_emul_inject_fault(wheel_emul, AS5600_EMUL_FAULT_POWER_LOSS, LONG_FAULT_TRANSFERS);
+	zassert_equal(as5600_emul_get_conf(wheel_emul), 0);
+
+	failed = fetch_until_ok(LONG_FAULT_TRANSFERS);
+	zassert_true(failed <= RECOVERY_PERIODS_MAX, "%u failed periods after the bus came back",
+		     failed);
+
+	/* Written back by the first transfer that got through */
+	zassert_equal(as5600_emul_get_conf(wheel_emul), conf, "CONF 0x%04x, expected 0x%04x",
+		      as5600_emul_get_conf(wheel_emul), conf);
+
+	stats_get(&stats);
+	zassert_true(stats.recovery_failures > stats_before.recovery_failures);
+	zassert_equal(stats.conf_restores - stats_before.conf_restores, 1);
+}
+
+ZTEST(as5600_recovery, test_power_loss_short)
+{
+	struct as5600_stats stats;
+	uint16_t conf = as5600_emul_get_conf(wheel_emul);
+
+	/* Back before the retries ran out: CONF is only restored by a recovery */
+	as5600_emul_inject_fault(wheel_emul, AS5600_EMUL_FAULT_POWER_LOSS,
+				 CONFIG_CUSTOM_AS5600_RETRIES + 1);
+	zassert_ok(sensor_sample_fetch_chan(wheel, SENSOR_CHAN_ROTATION));
+	zassert_equal(as5600_emul_get_conf(wheel_emul), conf);
+
+	stats_get(&stats);
+	zassert_equal(stats.bus_recoveries - stats_before.bus_recoveries, 1);
+	zassert_equal(stats.conf_restores - stats_before.conf_restores, 1);
+}
+
+static void *as5600_recovery_setup(void)
+{
+	zassert_true(device_is_ready(wheel), "AS5600 not ready");
+
+	/* A CONF that differs from the power-on value, so that a lost one shows */
+	attr_set(AS5600_HYSTERESIS, AS5600_HYSTERESIS_2LSB);
+	attr_set(AS5600_SLOW_FILTER, AS5600_SLOW_FILTER_4x);
+	zassert_not_equal(as5600_emul_get_conf(wheel_emul), 0);
+
+	return NULL;
+}
+
+static void as5600_recovery_before(void *fixture)
+{
+	/* Let a backoff left by the previous test run out */
+	as5600_emul_inject_fault(wheel_emul, AS5600_EMUL_FAULT_NONE, 0);
+	k_sleep(K_MSEC(CONFIG_CUSTOM_AS5600_BACKOFF_MAX_MS));
+	zassert_ok(sensor_sample_fetch_chan(wheel, SENSOR_CHAN_ROTATION));
+
+	stats_get(&stats_before);
+}
+
+ZTEST_SUITE(as5600_recovery, NULL, as5600_recovery_setup, as5600_recovery_before, NULL, NULL);
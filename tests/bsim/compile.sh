@@ -0,0 +1,32 @@
+#!/usr/bin/env bash
+# SPDX-License-Identifier: LicenseRef-Nordic-5-Clause
+#
+# Build the scroll wheel and the HID central for nrf52_bsim. Needs a west
+# workspace with BabbleSim set up, see the Zephyr bsim documentation.
+#
+#   tests/bsim/compile.sh [build dir]
+#
+# Two pairs of images: the wheel with overlay-energy.conf and a central
+# that connects after the advertising scenario, for energy.sh, and the
+# wheel with dfu.conf and a central that uploads an image, for dfu.sh.
+# MCUboot is left out, the simulated board boots the image directly.
+
+set -eu
+
+script_dir=$(cd "$(dirname "${BASH_SOURCE[0]}")" && pwd)
+app_dir=$(cd "${script_dir}/../.." && pwd)
+build_dir=${1:-${app_dir}/build_bsim}
+
+west build -b nrf52_bsim --no-sysbuild -p auto -d "${build_dir}/wheel" "${app_dir}" -- \
+	-DEXTRA_CONF_FILE=overlay-energy.conf
+
+# The central connects once the advertising scenario is over
+scenario_s=$(sed -n 's/^CONFIG_SCROLL_ENERGY_SCENARIO_S=//p' "${build_dir}/wheel/zephyr/.config")
+
+west build -b nrf52_bsim --no-sysbuild -p auto -d "${build_dir}/hid_central" \
+	"${script_dir}/hid_central" -- -DCONFIG_HID_CENTRAL_CONNECT_DELAY_S=$((scenario_s + 2))
+
+west build -b nrf52_bsim --no-sysbuild -p auto -d "${build_dir}/wheel_dfu" "${app_dir}" -- \
+	-DEXTRA_CONF_FILE="${script_dir}/dfu.conf"
+west build -b nrf52_bsim --no-sysbuild -p auto -d "${build_dir}/hid_central_smp" \
+	"${script_dir}/hid_central" -- -DEXTRA_CONF_FILE=overlay-smp.conf
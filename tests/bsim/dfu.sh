@@ -0,0 +1,36 @@
+#!/usr/bin/env bash
+# SPDX-License-Identifier: LicenseRef-Nordic-5-Clause
+#
+# Upload an image to the wheel over SMP from the scripted client in
+# hid_central while the emulated wheel turns. Passes if the wheel moved the
+# link to 2M PHY, long packets and a short interval for the transfer, put
+# all three back afterwards, and kept sending scroll reports throughout.
+#
+#   tests/bsim/compile.sh && tests/bsim/dfu.sh [build dir]
+
+set -eu
+
+: "${BSIM_OUT_PATH:?must point to the BabbleSim build}"
+
+script_dir=$(cd "$(dirname "${BASH_SOURCE[0]}")" && pwd)
+build_dir=${1:-$(cd "${script_dir}/../.." && pwd)/build_bsim}
+wheel=${build_dir}/wheel_dfu/zephyr/zephyr.exe
+central=${build_dir}/hid_central_smp/zephyr/zephyr.exe
+simulation_id=scroll_dfu_$$
+log=${build_dir}/dfu.log
+
+# Connect and pair, CONFIG_HID_CENTRAL_SMP_START_S, the upload and the restore
+sim_length_us=$((90 * 1000000))
+
+"${wheel}" -s=${simulation_id} -d=0 -RealEncryption=1 > "${build_dir}/dfu_wheel.log" 2>&1 &
+"${central}" -s=${simulation_id} -d=1 -RealEncryption=1 > "${log}" 2>&1 &
+"${BSIM_OUT_PATH}/bin/bs_2G4_phy_v1" -s=${simulation_id} -D=2 -sim_length=${sim_length_us} \
+	> /dev/null 2>&1 &
+wait
+
+grep -E "Link:|Uploaded|SMP upload" "${log}" || true
+
+if ! grep -q "SMP upload PASSED" "${log}"; then
+	echo "SMP upload test failed, see ${log} and ${build_dir}/dfu_wheel.log" >&2
+	exit 1
+fi
@@ -0,0 +1,51 @@
+#!/usr/bin/env bash
+# SPDX-License-Identifier: LicenseRef-Nordic-5-Clause
+#
+# Run the four energy scenarios of overlay-energy.conf against the HID
+# central and print the estimated average current of each. The central
+# stays off the air for the advertising scenario and connects afterwards.
+#
+#   tests/bsim/compile.sh && tests/bsim/energy.sh [build dir]
+#
+# The currents come from the CONFIG_SCROLL_ENERGY_* constants applied to
+# the simulated radio, CPU and sensor time, compare runs with each other
+# rather than with a meter.
+
+set -eu
+
+: "${BSIM_OUT_PATH:?must point to the BabbleSim build}"
+
+script_dir=$(cd "$(dirname "${BASH_SOURCE[0]}")" && pwd)
+build_dir=${1:-$(cd "${script_dir}/../.." && pwd)/build_bsim}
+wheel=${build_dir}/wheel/zephyr/zephyr.exe
+central=${build_dir}/hid_central/zephyr/zephyr.exe
+simulation_id=scroll_energy_$$
+log=${build_dir}/energy.log
+
+scenario_s=$(sed -n 's/^CONFIG_SCROLL_ENERGY_SCENARIO_S=//p' "${build_dir}/wheel/zephyr/.config")
+if [ -z "${scenario_s}" ]; then
+	echo "${build_dir}/wheel is not an energy scenario build, run compile.sh" >&2
+	exit 1
+fi
+
+# Advertising, then three connected scenarios, plus time to connect and pair
+sim_length_us=$(( (4 * scenario_s + 30) * 1000000 ))
+
+"${wheel}" -s=${simulation_id} -d=0 -RealEncryption=1 > "${log}" 2>&1 &
+"${central}" -s=${simulation_id} -d=1 -RealEncryption=1 > /dev/null 2>&1 &
+"${BSIM_OUT_PATH}/bin/bs_2G4_phy_v1" -s=${simulation_id} -D=2 -sim_length=${sim_length_us} \
+	> /dev/null 2>&1 &
+wait
+
+# "<name>: <ms> ms, radio <us> us, CPU <us> us, sensor <ms> ms, <n> wakeups, <nA> nAh/h"
+results=$(sed -n 's/.*energy: \(.*\): \([0-9]*\) ms, radio \([0-9]*\) us, CPU \([0-9]*\) us, sensor \([0-9]*\) ms, \([0-9]*\) wakeups, \([0-9]*\) nAh\/h.*/\1|\3|\4|\5|\6|\7/p' "${log}")
+
+printf '%-22s %10s %10s %10s %10s %10s\n' scenario "radio ms" "CPU ms" "sensor ms" wakeups "uAh/h"
+echo "${results}" | awk -F'|' 'NF == 6 {
+	printf "%-22s %10.1f %10.1f %10u %10u %10.1f\n", $1, $2 / 1000, $3 / 1000, $4, $5, $6 / 1000
+}'
+
+if [ "$(echo "${results}" | grep -c '|')" -ne 4 ]; then
+	echo "Not all scenarios finished, see ${log}" >&2
+	exit 1
+fi
@@ -0,0 +1,19 @@
+#ifndef _HID_CENTRAL_H_
+#define _HID_CENTRAL_H_
+
+#include <zephyr/types.h>
+#include <zephyr/bluetooth/conn.h>
+
+/* Start measuring the longest pause between input reports */
+void reports_gap_reset(void);
+/* Input reports since the last reset, and the longest pause between them */
+uint32_t reports_gap_get(uint32_t *max_gap_ms);
+
+#if CONFIG_HID_CENTRAL_SMP_UPLOAD
+/* Find the SMP service and upload the image after CONFIG_HID_CENTRAL_SMP_START_S */
+void smp_upload_start(struct bt_conn *conn);
+#else
+static inline void smp_upload_start(struct bt_conn *conn) {}
+#endif
+
+#endif /* _HID_CENTRAL_H_ */
@@ -0,0 +1,274 @@
+/*
+ * HID host for the scroll wheel on nrf52_bsim. Scans for the HID service
+ * once the connect delay has passed, pairs Just Works and subscribes to
+ * every input report through the HOGP client, like a desktop host does.
+ * Received reports are counted and logged, so a run shows whether the
+ * wheel kept reporting. With CONFIG_HID_CENTRAL_SMP_UPLOAD an image upload
+ * follows, see smp_upload.c.
+ */
+#include <zephyr/kernel.h>
+#include <zephyr/sys/byteorder.h>
+#include <zephyr/bluetooth/bluetooth.h>
+#include <zephyr/bluetooth/conn.h>
+#include <zephyr/bluetooth/gatt.h>
+#include <zephyr/bluetooth/uuid.h>
+#include <zephyr/logging/log.h>
+
+#include <bluetooth/gatt_dm.h>
+#include <bluetooth/services/hogp.h>
+
+#include "hid_central.h"
+
+LOG_MODULE_REGISTER(hid_central, CONFIG_HID_CENTRAL_LOG_LEVEL);
+
+static const struct bt_le_conn_param conn_param =
+	BT_LE_CONN_PARAM_INIT(CONFIG_HID_CENTRAL_INTERVAL, CONFIG_HID_CENTRAL_INTERVAL, 0, 400);
+
+static struct bt_conn *default_conn;
+static struct bt_hogp hogp;
+static atomic_t reports;
+
+/* Reports and the longest pause between them since reports_gap_reset() */
+static struct {
+	int64_t last_at;
+	uint32_t count;
+	uint32_t max_gap_ms;
+} gap;
+static struct k_spinlock gap_lock;
+
+static void scan_start(void);
+
+static bool ad_has_hids(struct bt_data *data, void *user_data)
+{
+	bool *found = user_data;
+
+	if (data->type != BT_DATA_UUID16_ALL && data->type != BT_DATA_UUID16_SOME) {
+		return true;
+	}
+
+	for (size_t i = 0; i + 1 < data->data_len; i += 2) {
+		if (sys_get_le16(&data->data[i]) == BT_UUID_HIDS_VAL) {
+			*found = true;
+			return false;
+		}
+	}
+
+	return true;
+}
+
+static void device_found(const bt_addr_le_t *addr, int8_t rssi, uint8_t type,
+			 struct net_buf_simple *ad)
+{
+	bool hids = false;
+	int err;
+
+	if (default_conn || type != BT_GAP_ADV_TYPE_ADV_IND) {
+		return;
+	}
+
+	bt_data_parse(ad, ad_has_hids, &hids);
+	if (!hids || bt_le_scan_stop()) {
+		return;
+	}
+
+	err = bt_conn_le_create(addr, BT_CONN_LE_CREATE_CONN, &conn_param, &default_conn);
+	if (err) {
+		LOG_ERR("Create connection failed (err %d)", err);
+		scan_start();
+	}
+}
+
+static void scan_start(void)
+{
+	int err = bt_le_scan_start(BT_LE_SCAN_PASSIVE, device_found);
+
+	if (err) {
+		LOG_ERR("Scanning failed to start (err %d)", err);
+	}
+}
+
+static uint8_t report_notify(struct bt_hogp *hogp, struct bt_hogp_rep_info *rep, uint8_t err,
+			     const uint8_t *data)
+{
+	if (data) {
+		int64_t now = k_uptime_get();
+		k_spinlock_key_t key = k_spin_lock(&gap_lock);
+
+		atomic_inc(&reports);
+		gap.max_gap_ms = MAX(gap.max_gap_ms, (uint32_t)(now - gap.last_at));
+		gap.last_at = now;
+		gap.count++;
+		k_spin_unlock(&gap_lock, key);
+	}
+
+	return BT_GATT_ITER_CONTINUE;
+}
+
+void reports_gap_reset(void)
+{
+	k_spinlock_key_t key = k_spin_lock(&gap_lock);
+
+	gap.last_at = k_uptime_get();
+	gap.count = 0;
+	gap.max_gap_ms = 0;
+	k_spin_unlock(&gap_lock, key);
+}
+
+/* A pause still running counts as well */
+uint32_t reports_gap_get(uint32_t *max_gap_ms)
+{
+	k_spinlock_key_t key = k_spin_lock(&gap_lock);
+	uint32_t count = gap.count;
+
+	*max_gap_ms = MAX(gap.max_gap_ms, (uint32_t)(k_uptime_get() - gap.last_at));
+	k_spin_unlock(&gap_lock, key);
+
+	return count;
+}
+
+static void hogp_ready(struct bt_hogp *hogp)
+{
+	struct bt_hogp_rep_info *rep = NULL;
+
+	while ((rep = bt_hogp_rep_next(hogp, rep)) != NULL) {
+		if (bt_hogp_rep_type(rep) != BT_HIDS_REPORT_TYPE_INPUT) {
+			continue;
+		}
+
+		int err = bt_hogp_rep_subscribe(hogp, rep, report_notify);
+
+		if (err) {
+			LOG_ERR("Cannot subscribe to report %u (err %d)", bt_hogp_rep_id(rep), err);
+		}
+	}
+
+	LOG_INF("Subscribed to the input reports");
+
+	smp_upload_start(default_conn);
+}
+
+static void hogp_prep_error(struct bt_hogp *hogp, int err)
+{
+	LOG_ERR("HOGP preparation failed (err %d)", err);
+}
+
+static void hogp_pm_update(struct bt_hogp *hogp)
+{
+}
+
+static const struct bt_hogp_init_params hogp_params = {
+	.ready_cb = hogp_ready,
+	.prep_error_cb = hogp_prep_error,
+	.pm_update_cb = hogp_pm_update,
+};
+
+static void discovery_completed(struct bt_gatt_dm *dm, void *context)
+{
+	int err = bt_hogp_handles_assign(dm, &hogp);
+
+	if (err) {
+		LOG_ERR("Cannot assign HOGP handles (err %d)", err);
+	}
+
+	bt_gatt_dm_data_release(dm);
+}
+
+static void discovery_service_not_found(struct bt_conn *conn, void *context)
+{
+	LOG_ERR("No HID service");
+}
+
+static void discovery_error(struct bt_conn *conn, int err, void *context)
+{
+	LOG_ERR("Discovery failed (err %d)", err);
+}
+
+static const struct bt_gatt_dm_cb discovery_cb = {
+	.completed = discovery_completed,
+	.service_not_found = discovery_service_not_found,
+	.error_found = discovery_error,
+};
+
+static void connected(struct bt_conn *conn, uint8_t conn_err)
+{
+	int err;
+
+	if (conn_err) {
+		LOG_ERR("Connection failed (err 0x%02x)", conn_err);
+		bt_conn_unref(default_conn);
+		default_conn = NULL;
+		scan_start();
+		return;
+	}
+
+	LOG_INF("Connected");
+
+	err = bt_conn_set_security(conn, BT_SECURITY_L2);
+	if (err) {
+		LOG_ERR("Cannot set security (err %d)", err);
+	}
+}
+
+static void disconnected(struct bt_conn *conn, uint8_t reason)
+{
+	if (conn != default_conn) {
+		return;
+	}
+
+	LOG_INF("Disconnected (reason 0x%02x)", reason);
+
+	if (bt_hogp_assign_check(&hogp)) {
+		bt_hogp_release(&hogp);
+	}
+	bt_conn_unref(default_conn);
+	default_conn = NULL;
+	scan_start();
+}
+
+/* The reports are readable with encryption only, discovery waits for it */
+static void security_changed(struct bt_conn *conn, bt_security_t level, enum bt_security_err err)
+{
+	if (err) {
+		LOG_ERR("Pairing failed (err %d)", err);
+		return;
+	}
+
+	LOG_INF("Security level %u", level);
+
+	if (!bt_hogp_assign_check(&hogp)) {
+		int dm_err = bt_gatt_dm_start(conn, BT_UUID_HIDS, &discovery_cb, NULL);
+
+		if (dm_err) {
+			LOG_ERR("Cannot start discovery (err %d)", dm_err);
+		}
+	}
+}
+
+BT_CONN_CB_DEFINE(conn_callbacks) = {
+	.connected = connected,
+	.disconnected = disconnected,
+	.security_changed = security_changed,
+};
+
+int main(void)
+{
+	int err;
+
+	bt_hogp_init(&hogp, &hogp_params);
+
+	err = bt_enable(NULL);
+	if (err) {
+		LOG_ERR("Bluetooth init failed (err %d)", err);
+		return 0;
+	}
+
+	k_sleep(K_SECONDS(CONFIG_HID_CENTRAL_CONNECT_DELAY_S));
+	scan_start();
+
+	for (;;) {
+		k_sleep(K_SECONDS(CONFIG_HID_CENTRAL_REPORT_LOG_S));
+		LOG_INF("Reports received: %u", (uint32_t)atomic_get(&reports));
+	}
+
+	return 0;
+}
@@ -0,0 +1,349 @@
+/*
+ * Scripted SMP client: uploads a generated image to the wheel's image
+ * group the way mcumgr does, one request per chunk, and checks what the
+ * wheel does to the link around it. During the transfer the wheel must
+ * have moved to 2M PHY, long packets and a short interval; afterwards the
+ * link must be back where it was, and scroll reports must not have
+ * stopped at any point.
+ */
+#include <string.h>
+#include <zephyr/kernel.h>
+#include <zephyr/sys/byteorder.h>
+#include <zephyr/bluetooth/conn.h>
+#include <zephyr/bluetooth/gatt.h>
+#include <zephyr/logging/log.h>
+#include <zcbor_encode.h>
+#include <zcbor_decode.h>
+
+#include <bluetooth/gatt_dm.h>
+#include <bluetooth/services/dfu_smp.h>
+
+#include "hid_central.h"
+
+LOG_MODULE_DECLARE(hid_central, CONFIG_HID_CENTRAL_LOG_LEVEL);
+
+#define SMP_OP_WRITE 2
+#define SMP_GROUP_IMAGE 1
+#define SMP_ID_IMAGE_UPLOAD 1
+
+/* Image header as MCUboot lays it out, img_mgmt rejects an upload without one */
+#define IMAGE_MAGIC 0x96f3b83d
+#define IMAGE_HEADER_SIZE 32
+
+/* Longest interval the wheel asks for during an upload, see DFU_CONN_PARAM */
+#define UPLOAD_INTERVAL_MAX 12
+/* Time for the wheel's restore procedures after the last chunk */
+#define RESTORE_WAIT_S 5
+#define RESPONSE_TIMEOUT K_SECONDS(5)
+
+struct link_state {
+	uint16_t interval;
+	uint8_t rx_phy;		/* the wheel's transmit side */
+	uint16_t rx_max_len;
+};
+
+static struct bt_dfu_smp dfu_smp;
+static struct bt_conn *upload_conn;
+static K_SEM_DEFINE(start_sem, 0, 1);
+static K_SEM_DEFINE(rsp_sem, 0, 1);
+
+/* Latest response, reassembled from its notifications */
+static struct {
+	uint8_t buf[128];
+	size_t len;
+	bool overflow;
+} rsp;
+
+static bool failed;
+
+#define CHECK(cond, fmt, ...)                                                                      \
+	do {                                                                                       \
+		if (!(cond)) {                                                                     \
+			LOG_ERR("SMP upload check failed: " fmt, ##__VA_ARGS__);                   \
+			failed = true;                                                             \
+		}                                                                                  \
+	} while (0)
+
+static int link_state_get(struct link_state *state)
+{
+	struct bt_conn_info info;
+	int err = bt_conn_get_info(upload_conn, &info);
+
+	if (err) {
+		return err;
+	}
+
+	state->interval = info.le.interval;
+	state->rx_phy = info.le.phy->rx_phy;
+	state->rx_max_len = info.le.data_len->rx_max_len;
+
+	LOG_INF("Link: interval %u, PHY %u, %u byte packets", state->interval, state->rx_phy,
+		state->rx_max_len);
+
+	return 0;
+}
+
+static void rsp_part(struct bt_dfu_smp *smp)
+{
+	const struct bt_dfu_smp_rsp_state *state = bt_dfu_smp_rsp_state(smp);
+
+	if (state->offset + state->chunk_size > sizeof(rsp.buf)) {
+		rsp.overflow = true;
+	} else {
+		memcpy(&rsp.buf[state->offset], state->data, state->chunk_size);
+	}
+
+	if (bt_dfu_smp_rsp_total_check(smp)) {
+		rsp.len = state->total_size;
+		k_sem_give(&rsp_sem);
+	}
+}
+
+static void smp_error(struct bt_dfu_smp *smp, int err)
+{
+	LOG_ERR("SMP error %d", err);
+}
+
+static const struct bt_dfu_smp_init_params smp_params = {
+	.error_cb = smp_error,
+};
+
+/* Image bytes: a header img_mgmt accepts, then a pattern */
+static uint8_t image_byte(uint32_t off)
+{
+	static uint8_t header[IMAGE_HEADER_SIZE];
+
+	if (off == 0) {
+		sys_put_le32(IMAGE_MAGIC, &header[0]);
+		sys_put_le16(IMAGE_HEADER_SIZE, &header[8]);
+		sys_put_le32(CONFIG_HID_CENTRAL_SMP_IMAGE_SIZE - IMAGE_HEADER_SIZE, &header[12]);
+	}
+
+	return off < IMAGE_HEADER_SIZE ? header[off] : (uint8_t)(off * 31U);
+}
+
+/* Send one chunk and return the offset the wheel expects next, or a negative error */
+static int64_t upload_chunk(uint32_t off)
+{
+	static uint8_t cmd[sizeof(struct bt_dfu_smp_header) + CONFIG_HID_CENTRAL_SMP_CHUNK + 48];
+	static uint8_t data[CONFIG_HID_CENTRAL_SMP_CHUNK];
+	struct bt_dfu_smp_header *hdr = (struct bt_dfu_smp_header *)cmd;
+	uint8_t *payload = &cmd[sizeof(*hdr)];
+	uint32_t len = MIN(CONFIG_HID_CENTRAL_SMP_CHUNK, CONFIG_HID_CENTRAL_SMP_IMAGE_SIZE - off);
+	zcbor_state_t zs[2];
+	struct zcbor_string key;
+	uint32_t next_off = UINT32_MAX;
+	int32_t rc = 0;
+	size_t payload_len;
+	bool ok;
+	int err;
+
+	for (uint32_t i = 0; i < len; i++) {
+		data[i] = image_byte(off + i);
+	}
+
+	zcbor_new_encode_state(zs, ARRAY_SIZE(zs), payload, sizeof(cmd) - sizeof(*hdr), 0);
+	ok = zcbor_map_start_encode(zs, 5) &&
+	     zcbor_tstr_put_lit(zs, "image") && zcbor_uint32_put(zs, 0) &&
+	     zcbor_tstr_put_lit(zs, "off") && zcbor_uint32_put(zs, off) &&
+	     zcbor_tstr_put_lit(zs, "data") && zcbor_bstr_encode_ptr(zs, (const char *)data, len);
+	if (ok && off == 0) {
+		ok = zcbor_tstr_put_lit(zs, "len") &&
+		     zcbor_uint32_put(zs, CONFIG_HID_CENTRAL_SMP_IMAGE_SIZE);
+	}
+	ok = ok && zcbor_map_end_encode(zs, 5);
+	if (!ok) {
+		return -ENOMEM;
+	}
+	payload_len = zs->payload - payload;
+
+	memset(hdr, 0, sizeof(*hdr));
+	hdr->op = SMP_OP_WRITE;
+	hdr->len_h8 = payload_len >> 8;
+	hdr->len_l8 = payload_len & 0xff;
+	hdr->group_h8 = 0;
+	hdr->group_l8 = SMP_GROUP_IMAGE;
+	hdr->id = SMP_ID_IMAGE_UPLOAD;
+
+	rsp.overflow = false;
+	k_sem_reset(&rsp_sem);
+	err = bt_dfu_smp_command(&dfu_smp, rsp_part, sizeof(*hdr) + payload_len, cmd);
+	if (err) {
+		return err;
+	}
+	if (k_sem_take(&rsp_sem, RESPONSE_TIMEOUT) || rsp.overflow ||
+	    rsp.len < sizeof(struct bt_dfu_smp_header)) {
+		return -ETIMEDOUT;
+	}
+
+	/* {"rc": <err>, "off": <next offset>} */
+	zcbor_new_decode_state(zs, ARRAY_SIZE(zs), &rsp.buf[sizeof(*hdr)],
+			       rsp.len - sizeof(*hdr), 1, NULL, 0);
+	if (!zcbor_map_start_decode(zs)) {
+		return -EBADMSG;
+	}
+	while (!zcbor_array_at_end(zs)) {
+		if (!zcbor_tstr_decode(zs, &key)) {
+			return -EBADMSG;
+		}
+		if (key.len == 3 && memcmp(key.value, "off", 3) == 0) {
+			ok = zcbor_uint32_decode(zs, &next_off);
+		} else if (key.len == 2 && memcmp(key.value, "rc", 2) == 0) {
+			ok = zcbor_int32_decode(zs, &rc);
+		} else {
+			ok = zcbor_any_skip(zs, NULL);
+		}
+		if (!ok) {
+			return -EBADMSG;
+		}
+	}
+	zcbor_map_end_decode(zs);
+
+	if (rc != 0) {
+		LOG_ERR("Upload rejected at %u, rc %d", off, rc);
+		return -EIO;
+	}
+
+	return next_off == UINT32_MAX ? -EBADMSG : next_off;
+}
+
+/* Runs in its own thread, the host stack needs the system workqueue meanwhile */
+static void upload(void)
+{
+	struct link_state before;
+	struct link_state during = { 0 };
+	struct link_state after;
+	uint32_t reports;
+	uint32_t max_gap_ms;
+	int64_t started_at;
+	int64_t off = 0;
+
+	if (link_state_get(&before)) {
+		LOG_ERR("SMP upload FAILED: not connected");
+		return;
+	}
+
+	LOG_INF("Uploading %u bytes", CONFIG_HID_CENTRAL_SMP_IMAGE_SIZE);
+	started_at = k_uptime_get();
+	reports_gap_reset();
+
+	while (off < CONFIG_HID_CENTRAL_SMP_IMAGE_SIZE) {
+		bool past_half = off >= CONFIG_HID_CENTRAL_SMP_IMAGE_SIZE / 2;
+
+		off = upload_chunk((uint32_t)off);
+		if (off < 0) {
+			LOG_ERR("SMP upload FAILED: chunk error %lld", off);
+			return;
+		}
+		if (!past_half && off >= CONFIG_HID_CENTRAL_SMP_IMAGE_SIZE / 2) {
+			link_state_get(&during);
+		}
+	}
+
+	reports = reports_gap_get(&max_gap_ms);
+	LOG_INF("Uploaded in %lld ms, %u reports, longest pause %u ms",
+		k_uptime_get() - started_at, reports, max_gap_ms);
+
+	k_sleep(K_SECONDS(RESTORE_WAIT_S));
+	link_state_get(&after);
+
+	/* Sped up while the transfer ran */
+	CHECK(during.interval <= UPLOAD_INTERVAL_MAX && during.interval != before.interval,
+	      "interval %u during the upload, %u before", during.interval, before.interval);
+	CHECK(during.rx_phy == BT_GAP_LE_PHY_2M && before.rx_phy != BT_GAP_LE_PHY_2M,
+	      "PHY %u during the upload, %u before", during.rx_phy, before.rx_phy);
+	CHECK(during.rx_max_len > before.rx_max_len,
+	      "%u byte packets during the upload, %u before", during.rx_max_len,
+	      before.rx_max_len);
+
+	/* And back afterwards */
+	CHECK(after.interval == before.interval, "interval %u after the upload, %u before",
+	      after.interval, before.interval);
+	CHECK(after.rx_phy == before.rx_phy, "PHY %u after the upload, %u before",
+	      after.rx_phy, before.rx_phy);
+	CHECK(after.rx_max_len == before.rx_max_len,
+	      "%u byte packets after the upload, %u before", after.rx_max_len, before.rx_max_len);
+
+	/* Scrolling never stopped */
+	CHECK(reports > 0, "no reports during the upload");
+	CHECK(max_gap_ms <= CONFIG_HID_CENTRAL_REPORT_GAP_MAX_MS,
+	      "reports paused for %u ms during the upload", max_gap_ms);
+
+	if (failed) {
+		LOG_ERR("SMP upload FAILED");
+	} else {
+		LOG_INF("SMP upload PASSED");
+	}
+}
+
+static void discovery_completed(struct bt_gatt_dm *dm, void *context)
+{
+	int err = bt_dfu_smp_handles_assign(dm, &dfu_smp);
+
+	bt_gatt_dm_data_release(dm);
+
+	if (err) {
+		LOG_ERR("SMP upload FAILED: cannot assign SMP handles (err %d)", err);
+		return;
+	}
+
+	k_sem_give(&start_sem);
+}
+
+static void discovery_service_not_found(struct bt_conn *conn, void *context)
+{
+	LOG_ERR("SMP upload FAILED: no SMP service");
+}
+
+static void discovery_error(struct bt_conn *conn, int err, void *context)
+{
+	LOG_ERR("SMP upload FAILED: discovery error %d", err);
+}
+
+static const struct bt_gatt_dm_cb discovery_cb = {
+	.completed = discovery_completed,
+	.service_not_found = discovery_service_not_found,
+	.error_found = discovery_error,
+};
+
+static void mtu_exchanged(struct bt_conn *conn, uint8_t att_err,
+			  struct bt_gatt_exchange_params *params)
+{
+	int err;
+
+	if (att_err) {
+		LOG_WRN("MTU exchange failed (err %u)", att_err);
+	}
+
+	err = bt_gatt_dm_start(conn, BT_UUID_DFU_SMP_SERVICE, &discovery_cb, NULL);
+	if (err) {
+		LOG_ERR("SMP upload FAILED: cannot start discovery (err %d)", err);
+	}
+}
+
+static struct bt_gatt_exchange_params mtu_params = {
+	.func = mtu_exchanged,
+};
+
+void smp_upload_start(struct bt_conn *conn)
+{
+	int err;
+
+	upload_conn = conn;
+	bt_dfu_smp_init(&dfu_smp, &smp_params);
+
+	/* Each request goes out as a single write */
+	err = bt_gatt_exchange_mtu(conn, &mtu_params);
+	if (err) {
+		mtu_exchanged(conn, 0, &mtu_params);
+	}
+}
+
+static void upload_thread(void)
+{
+	k_sem_take(&start_sem, K_FOREVER);
+	k_sleep(K_SECONDS(CONFIG_HID_CENTRAL_SMP_START_S));
+	upload();
+}
+
+K_THREAD_DEFINE(smp_upload_tid, 2048, upload_thread, NULL, NULL, NULL, 7, 0, 0);
@@ -0,0 +1,178 @@
+/*
+ * Dial personality of the sampling thread against the AS5600 emulator.
+ * The wheel is connected and in the dial personality throughout. A wheel
+ * at rest flickers by a raw count either way; that must neither reach the
+ * host nor keep the sensor in the active mode, while real rotation still
+ * adds up to the distance turned.
+ */
+#include <zephyr/ztest.h>
+#include <zephyr/drivers/emul.h>
+#include <stdlib.h>
+
+#include "magnetometer.h"
+#include "scroll.h"
+#include "status_service.h"
+#include "boot_profile.h"
+#include "pairing.h"
+#include "calibration.h"
+#include "personality.h"
+#include "custom_as5600_emul.h"
+
+#define WHEEL_NODE DT_NODELABEL(wheel)
+
+/* Somewhere away from the wraparound */
+#define REST_RAW_ANGLE 2000
+/* 1/16 counts per raw count */
+#define RAW_COUNT (SCROLL_COUNTS_PER_REV / 4096)
+
+static const struct emul *const wheel_emul = EMUL_DT_GET(WHEEL_NODE);
+
+/* The application's side of the sampling thread */
+K_MSGQ_DEFINE(scroll_queue, sizeof(struct scroll_event), 50, 4);
+bool bt_connected;
+
+static void hids_handler(struct k_work *work)
+{
+}
+
+K_WORK_DEFINE(hids_work, hids_handler);
+
+void status_service_magnet_update(const struct magnet_health *health)
+{
+}
+
+void boot_profile_mark(enum boot_stage stage)
+{
+}
+
+bool advertising_is_stopped(void)
+{
+	return false;
+}
+
+void advertising_resume(void)
+{
+}
+
+/* No calibration table: raw counts in 1/16 counts */
+uint16_t calibration_correct(enum scroll_axis_id axis, uint16_t raw)
+{
+	return raw << 4;
+}
+
+enum hid_personality hid_personality_get(void)
+{
+	return HID_PERSONALITY_DIAL;
+}
+
+/* Take every event queued so far, returns the summed dial rotation and counts the dial reports */
+static int32_t dial_drain(uint32_t *reports)
+{
+	struct scroll_event event;
+	int32_t rotation;
+
+	*reports = 0;
+	while (k_msgq_get(&scroll_queue, &event, K_NO_WAIT) == 0) {
+		if (event.dial != 0) {
+			rotation += event.dial;
+			(*reports)++;
+		}
+	}
+
+	return rotation;
+}
+
+/* Move the angle once per active sample period, cycling through the offsets */
+static void angle_play(uint16_t base, const int8_t *offsets, size_t count, uint32_t duration_ms)
+{
+	for (uint32_t t = 0, i = 0; t < duration_ms; t += ACTIVE_MODE_PERIOD_MS, i++) {
+		as5600_emul_set_raw_angle(wheel_emul, base + offsets[i % count]);
+		k_sleep(K_MSEC(ACTIVE_MODE_PERIOD_MS));
+	}
+}
+
+static const int8_t jitter[] = {0, 1, 0, -1, -1, 1};
+
+ZTEST(magnetometer_dial, test_jitter_not_reported)
+{
+	uint32_t reports;
+
+	angle_play(REST_RAW_ANGLE, jitter, ARRAY_SIZE(jitter), 1000);
+	dial_drain(&reports);
+	zassert_equal(reports, 0, "%u dial reports from a wheel at rest", reports);
+}
+
+ZTEST(magnetometer_dial, test_jitter_after_rotation_not_reported)
+{
+	uint32_t reports;
+	int32_t rotation;
+
+	/* A turn in steps above the deadband, the last one is the dial's reference */
+	for (uint16_t raw = REST_RAW_ANGLE + 4; raw <= REST_RAW_ANGLE + 40; raw += 4) {
+		as5600_emul_set_raw_angle(wheel_emul, raw);
+		k_sleep(K_MSEC(ACTIVE_MODE_PERIOD_MS));
+	}
+
+	k_sleep(K_MSEC(3 * ACTIVE_MODE_PERIOD_MS));
+	rotation = dial_drain(&reports);
+	zassert_equal(rotation, 40 * RAW_COUNT, "rotation %d reported for %d", rotation,
+		      40 * RAW_COUNT);
+
+	/* At rest one count further on: the noise reaches two counts past the reference */
+	angle_play(REST_RAW_ANGLE + 41, jitter, ARRAY_SIZE(jitter), 1000);
+	dial_drain(&reports);
+	zassert_equal(reports, 0, "%u dial reports from a wheel at rest", reports);
+}
+
+ZTEST(magnetometer_dial, test_jitter_steps_sensor_down)
+{
+	struct sample_timing before;
+	struct sample_timing after;
+	uint32_t samples;
+
+	/* Long enough to leave the active mode, then count samples at the low power period */
+	angle_play(REST_RAW_ANGLE, jitter, ARRAY_SIZE(jitter), LPM_TIMEOUT_MS + 500);
+	magnetometer_timing_get(&before);
+	angle_play(REST_RAW_ANGLE, jitter, ARRAY_SIZE(jitter), 1000);
+	magnetometer_timing_get(&after);
+
+	samples = after.samples - before.samples;
+	zassert_true(samples <= 1000 / LPM_MODE_PERIOD_MS + 1,
+		     "%u samples in a second, still in the active mode", samples);
+}
+
+static void *magnetometer_dial_setup(void)
+{
+	as5600_emul_set_raw_angle(wheel_emul, REST_RAW_ANGLE);
+	bt_connected = true;
+	magnetometer_start();
+
+	/* Power-up, configuration and the first sample as the reference */
+	k_sleep(K_MSEC(10 * ACTIVE_MODE_PERIOD_MS));
+
+	return NULL;
+}
+
+/* Move to an angle and wait until the move has been reported, in any power mode */
+static void dial_move(uint16_t raw)
+{
+	uint32_t reports = 0;
+
+	as5600_emul_set_raw_angle(wheel_emul, raw);
+	for (uint32_t t = 0; t < 2 * DOZE_MODE_PERIOD_MS && reports == 0;
+	     t += ACTIVE_MODE_PERIOD_MS) {
+		k_sleep(K_MSEC(ACTIVE_MODE_PERIOD_MS));
+		dial_drain(&reports);
+	}
+	zassert_not_equal(reports, 0, "move to %u not reported", raw);
+}
+
+static void magnetometer_dial_before(void *fixture)
+{
+	/* Back in the active mode, with the reference on the rest angle */
+	dial_move(REST_RAW_ANGLE + 20);
+	dial_move(REST_RAW_ANGLE);
+}
+
+ZTEST_SUITE(magnetometer_dial, NULL, magnetometer_dial_setup, magnetometer_dial_before, NULL,
+	    NULL);
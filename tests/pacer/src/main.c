@@ -0,0 +1,154 @@
+/*
+ * Report pacing on the system workqueue, without a connection: the pacer
+ * runs at its default interval. Every test moves the wheel, stops it and
+ * checks that the backlog is gone within a bounded number of intervals,
+ * so a stopped wheel never trails ticks into the host.
+ */
+#include <zephyr/ztest.h>
+#include <zephyr/bluetooth/conn.h>
+
+#include "pacer.h"
+#include "pairing.h"
+
+#define INTERVAL_MS (PACER_DEFAULT_INTERVAL_US / 1000)
+/*
+ * Intervals the last ticks may take once input stops: the quiet ones
+ * before the flush, plus the one the last push landed in
+ */
+#define DRAIN_INTERVALS_MAX (PACER_STOP_INTERVALS + 1)
+/* Give up on a backlog that never drains */
+#define WAIT_INTERVALS_MAX 1000
+
+/* No host is connected, the pacer keeps its default interval */
+conn_mode_t conn_mode[CONFIG_BT_HIDS_MAX_CLIENT_COUNT];
+
+int bt_conn_get_info(const struct bt_conn *conn, struct bt_conn_info *info)
+{
+	return -ENOTCONN;
+}
+
+static atomic_t ticks_sent;
+static atomic_t reports_sent;
+static int32_t ticks_pushed;
+
+static struct scroll_event push_event;
+
+static void scroll_send(const struct scroll_event *event)
+{
+	atomic_add(&ticks_sent, event->wheel);
+	atomic_inc(&reports_sent);
+}
+
+static void push_handler(struct k_work *work)
+{
+	pacer_push(&push_event);
+}
+
+static K_WORK_DEFINE(push_work, push_handler);
+
+/* Push from the system workqueue, as the HID work item does */
+static void push(int8_t wheel)
+{
+	struct k_work_sync sync;
+
+	push_event = (struct scroll_event){ .wheel = wheel };
+	zassert_true(k_work_submit(&push_work) >= 0);
+	k_work_flush(&push_work, &sync);
+	ticks_pushed += wheel;
+}
+
+/* Intervals after the last push until every tick has been sent */
+static uint32_t intervals_until_drained(void)
+{
+	for (uint32_t i = 0; i < WAIT_INTERVALS_MAX; i++) {
+		if (atomic_get(&ticks_sent) == ticks_pushed) {
+			return i;
+		}
+		k_sleep(K_MSEC(INTERVAL_MS));
+	}
+
+	zassert_unreachable("%d ticks still pending after %u intervals",
+			    ticks_pushed - (int32_t)atomic_get(&ticks_sent), WAIT_INTERVALS_MAX);
+
+	return UINT32_MAX;
+}
+
+ZTEST(pacer, test_slow_stop_drains)
+{
+	struct pacer_stats before;
+	struct pacer_stats stats;
+	uint32_t intervals;
+
+	pacer_stats_get(&before);
+
+	/* Half a tick per interval: the smoothed rate stays below one tick */
+	for (int i = 0; i < 20; i++) {
+		push(1);
+		k_sleep(K_MSEC(2 * INTERVAL_MS));
+	}
+
+	intervals = intervals_until_drained();
+	zassert_true(intervals <= DRAIN_INTERVALS_MAX, "drained after %u intervals", intervals);
+
+	pacer_stats_get(&stats);
+	zassert_equal(stats.reversals, before.reversals, "stop counted as a reversal");
+}
+
+ZTEST(pacer, test_fast_stop_drains)
+{
+	uint32_t intervals;
+
+	/* A spin sampled three times per interval */
+	for (int i = 0; i < 60; i++) {
+		push(6);
+		k_sleep(K_MSEC(INTERVAL_MS / 3));
+	}
+
+	intervals = intervals_until_drained();
+	zassert_true(intervals <= DRAIN_INTERVALS_MAX, "drained after %u intervals", intervals);
+}
+
+ZTEST(pacer, test_idle_after_stop)
+{
+	struct pacer_stats before;
+	struct pacer_stats stats;
+	atomic_val_t reports;
+
+	pacer_stats_get(&before);
+
+	for (int i = 0; i < 10; i++) {
+		push(2);
+		k_sleep(K_MSEC(INTERVAL_MS));
+	}
+	intervals_until_drained();
+
+	/* Nothing left to pace: no further reports, the next motion starts a new burst */
+	reports = atomic_get(&reports_sent);
+	k_sleep(K_MSEC((PACER_IDLE_INTERVALS + 1) * INTERVAL_MS));
+	zassert_equal(atomic_get(&reports_sent), reports, "reports after the backlog drained");
+
+	push(1);
+	zassert_equal(atomic_get(&ticks_sent), ticks_pushed, "first motion not sent at once");
+
+	pacer_stats_get(&stats);
+	zassert_equal(stats.bursts - before.bursts, 2);
+}
+
+static void *pacer_setup(void)
+{
+	pacer_init(scroll_send);
+
+	return NULL;
+}
+
+static void pacer_before(void *fixture)
+{
+	/* Let the previous test's pacing run out */
+	k_sleep(K_MSEC((PACER_STOP_INTERVALS + PACER_IDLE_INTERVALS + 2) * INTERVAL_MS));
+
+	atomic_set(&ticks_sent, 0);
+	atomic_set(&reports_sent, 0);
+	ticks_pushed = 0;
+}
+
+ZTEST_SUITE(pacer, NULL, pacer_setup, pacer_before, NULL, NULL);
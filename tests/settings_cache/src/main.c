@@ -0,0 +1,258 @@
+/*
+ * Settings cache on the NVS backend and the flash simulator. Every test
+ * compares the cache's own count of records written with the flash
+ * simulator's write calls, so a record the cache claims to hold back
+ * must not have reached the flash.
+ */
+#include <zephyr/ztest.h>
+#include <zephyr/settings/settings.h>
+#include <zephyr/storage/flash_map.h>
+#include <zephyr/stats/stats.h>
+#include <string.h>
+
+#include "settings_cache.h"
+
+/* Defined by main.c in the application */
+int64_t scroll_activity_at;
+
+static const uint8_t ccc_value[] = {0x01, 0x00, 0x2a, 0x00};
+static const uint8_t key_value[] = {0x10, 0x32, 0x54, 0x76, 0x98, 0xba, 0xdc, 0xfe};
+
+struct stored_record {
+	uint8_t value[32];
+	ssize_t len;		/* -ENOENT if the record is not in storage */
+};
+
+/* Counters at the start of a test */
+static struct settings_cache_stats stats_before;
+static uint32_t flash_writes_before;
+
+static int stat_find(struct stats_hdr *hdr, void *arg, const char *name, uint16_t off)
+{
+	if (strcmp(name, "flash_write_calls") == 0) {
+		*(uint32_t *)arg = *(uint32_t *)((uint8_t *)hdr + off);
+	}
+
+	return 0;
+}
+
+static uint32_t flash_write_calls(void)
+{
+	struct stats_hdr *hdr = stats_group_find("flash_sim_stats");
+	uint32_t calls = UINT32_MAX;
+
+	zassert_not_null(hdr, "flash simulator statistics not registered");
+	stats_walk(hdr, stat_find, &calls);
+	zassert_not_equal(calls, UINT32_MAX, "no flash_write_calls statistic");
+
+	return calls;
+}
+
+static int stored_cb(const char *key, size_t len, settings_read_cb read_cb, void *cb_arg,
+		     void *param)
+{
+	struct stored_record *record = param;
+
+	if (key == NULL) {
+		record->len = read_cb(cb_arg, record->value, MIN(len, sizeof(record->value)));
+	}
+
+	return 0;
+}
+
+/* Read a record straight from the NVS backend, the cache is not a load source */
+static ssize_t stored_get(const char *name, struct stored_record *record)
+{
+	record->len = -ENOENT;
+	zassert_ok(settings_load_subtree_direct(name, stored_cb, record));
+
+	/* Deleted records are stored with no value */
+	return record->len > 0 ? record->len : -ENOENT;
+}
+
+static void assert_stored(const char *name, const uint8_t *value, size_t len)
+{
+	struct stored_record record;
+
+	zassert_equal(stored_get(name, &record), len, "%s not in storage", name);
+	zassert_mem_equal(record.value, value, len, "%s stored with another value", name);
+}
+
+static void assert_not_stored(const char *name)
+{
+	struct stored_record record;
+
+	zassert_equal(stored_get(name, &record), -ENOENT, "%s in storage", name);
+}
+
+/*
+ * The cache must have handed exactly this many records to the backend
+ * since the test started, and the flash must have been written if and
+ * only if it did.
+ */
+static void assert_records_written(uint32_t records)
+{
+	struct settings_cache_stats stats;
+	uint32_t flash_writes = flash_write_calls() - flash_writes_before;
+
+	settings_cache_stats_get(&stats);
+
+	zassert_equal(stats.flash_writes - stats_before.flash_writes, records,
+		      "cache wrote %u records, expected %u",
+		      stats.flash_writes - stats_before.flash_writes, records);
+	if (records == 0) {
+		zassert_equal(flash_writes, 0, "%u flash writes with nothing written", flash_writes);
+	} else {
+		/* At least the data and its allocation table entry per record */
+		zassert_true(flash_writes >= 2 * records, "only %u flash writes for %u records",
+			     flash_writes, records);
+	}
+}
+
+ZTEST(settings_cache, test_unchanged_save_skipped)
+{
+	struct settings_cache_stats stats;
+
+	zassert_ok(settings_save_one("bt/keys/unchanged", key_value, sizeof(key_value)));
+	assert_records_written(1);
+
+	/* The same value again, as the host stack saves on every reconnection */
+	zassert_ok(settings_save_one("bt/keys/unchanged", key_value, sizeof(key_value)));
+	zassert_ok(settings_save_one("bt/keys/unchanged", key_value, sizeof(key_value)));
+	assert_records_written(1);
+
+	settings_cache_stats_get(&stats);
+	zassert_equal(stats.skipped - stats_before.skipped, 2);
+}
+
+ZTEST(settings_cache, test_bond_keys_written_through)
+{
+	struct settings_cache_stats stats;
+	uint8_t new_key[sizeof(key_value)];
+
+	zassert_ok(settings_save_one("bt/keys/bond", key_value, sizeof(key_value)));
+	assert_stored("bt/keys/bond", key_value, sizeof(key_value));
+	assert_records_written(1);
+
+	/* A changed key goes to storage at once as well */
+	memcpy(new_key, key_value, sizeof(new_key));
+	new_key[0] ^= 0xff;
+	zassert_ok(settings_save_one("bt/keys/bond", new_key, sizeof(new_key)));
+	assert_stored("bt/keys/bond", new_key, sizeof(new_key));
+	assert_records_written(2);
+
+	settings_cache_stats_get(&stats);
+	zassert_equal(stats.deferred, stats_before.deferred, "bond key deferred");
+	zassert_equal(stats.dirty, 0);
+}
+
+ZTEST(settings_cache, test_ccc_deferred_until_flush)
+{
+	struct settings_cache_stats stats;
+
+	zassert_ok(settings_save_one("bt/ccc/deferred", ccc_value, sizeof(ccc_value)));
+	assert_not_stored("bt/ccc/deferred");
+	assert_records_written(0);
+
+	settings_cache_stats_get(&stats);
+	zassert_equal(stats.deferred - stats_before.deferred, 1);
+	zassert_equal(stats.dirty, 1);
+
+	settings_cache_flush();
+	assert_stored("bt/ccc/deferred", ccc_value, sizeof(ccc_value));
+	assert_records_written(1);
+
+	settings_cache_stats_get(&stats);
+	zassert_equal(stats.dirty, 0);
+	zassert_equal(stats.flushes - stats_before.flushes, 1);
+
+	/* Nothing left to write */
+	settings_cache_flush();
+	assert_records_written(1);
+}
+
+ZTEST(settings_cache, test_ccc_rewrites_coalesced)
+{
+	uint8_t value[sizeof(ccc_value)];
+
+	memcpy(value, ccc_value, sizeof(value));
+
+	/* Subscriptions toggling back and forth while connected */
+	for (uint8_t i = 0; i < 10; i++) {
+		value[0] = i & 1;
+		zassert_ok(settings_save_one("bt/ccc/coalesced", value, sizeof(value)));
+	}
+	assert_records_written(0);
+
+	settings_cache_flush();
+	assert_stored("bt/ccc/coalesced", value, sizeof(value));
+	assert_records_written(1);
+}
+
+ZTEST(settings_cache, test_deferred_delete)
+{
+	zassert_ok(settings_save_one("bt/ccc/deleted", ccc_value, sizeof(ccc_value)));
+	settings_cache_flush();
+	assert_stored("bt/ccc/deleted", ccc_value, sizeof(ccc_value));
+	assert_records_written(1);
+
+	/* Held like any other CCC change, the record stays in storage meanwhile */
+	zassert_ok(settings_delete("bt/ccc/deleted"));
+	assert_stored("bt/ccc/deleted", ccc_value, sizeof(ccc_value));
+	assert_records_written(1);
+
+	settings_cache_flush();
+	assert_not_stored("bt/ccc/deleted");
+	assert_records_written(2);
+
+	/* Deleting what is already gone is skipped */
+	zassert_ok(settings_delete("bt/ccc/deleted"));
+	settings_cache_flush();
+	assert_records_written(2);
+}
+
+ZTEST(settings_cache, test_idle_flush)
+{
+	zassert_ok(settings_save_one("bt/cf/idle", ccc_value, 1));
+	assert_not_stored("bt/cf/idle");
+
+	/* No scrolling: the flush runs once the idle time has passed */
+	k_sleep(K_MSEC(2 * CONFIG_SCROLL_SETTINGS_CACHE_IDLE_MS));
+	assert_stored("bt/cf/idle", ccc_value, 1);
+	assert_records_written(1);
+}
+
+ZTEST(settings_cache, test_other_subtrees_written_through)
+{
+	uint8_t personality = 1;
+
+	zassert_ok(settings_save_one("hid/personality", &personality, sizeof(personality)));
+	assert_stored("hid/personality", &personality, sizeof(personality));
+	assert_records_written(1);
+}
+
+static void *settings_cache_setup(void)
+{
+	const struct flash_area *fa;
+
+	/* The simulator's flash may be file-backed and survive between runs */
+	zassert_ok(flash_area_open(FIXED_PARTITION_ID(storage_partition), &fa));
+	zassert_ok(flash_area_erase(fa, 0, fa->fa_size));
+	flash_area_close(fa);
+
+	zassert_ok(settings_subsys_init());
+	zassert_ok(settings_cache_init());
+
+	return NULL;
+}
+
+static void settings_cache_before(void *fixture)
+{
+	/* Nothing of a previous test may still be waiting */
+	settings_cache_flush();
+
+	settings_cache_stats_get(&stats_before);
+	flash_writes_before = flash_write_calls();
+}
+
+ZTEST_SUITE(settings_cache, NULL, settings_cache_setup, settings_cache_before, NULL, NULL);